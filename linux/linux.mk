@@ -52,3 +52,27 @@ INCLUDES += -I$(FFMPEG_INCLUDES)
 
 LDD_LIBS += -lobs
 LDD_FLAG += -shared
+
+# Out of process decoder, shipped in the plugin's data folder where
+# obs_module_file() finds it. It only needs libobs' util functions,
+# libavcodec and turbojpeg; not usbmuxd or imobiledevice.
+WORKER_EXE  ?= $(DATA_DIR)/droidcam-worker
+WORKER_SRC  += src/worker/main.cc src/video_stream.cc src/ffmpeg_decode.cc \
+	src/mjpeg_decode.cc src/net.cc src/uring_recv.cc
+WORKER_LIBS += -lobs $(shell pkg-config --libs-only-l libavcodec libavutil)
+
+ifeq "$(ALLOW_STATIC)" "yes"
+WORKER_LIBS += $(JPEG_LIB)/libturbojpeg.a
+else
+WORKER_LIBS += $(shell pkg-config --libs-only-l libturbojpeg)
+endif
+
+# The test program links all the plugin sources into an executable
+TEST_LIBS   += $(shell pkg-config --libs-only-l libavcodec libavformat libavutil libimobiledevice-1.0)
+
+all: $(WORKER_EXE)
+.PHONY: worker
+worker: $(WORKER_EXE)
+
+$(WORKER_EXE): $(WORKER_SRC)
+	$(CXX) $(CXXFLAGS) $(INCLUDES) $^ $(WORKER_LIBS) -lpthread -o $@
@@ -0,0 +1,177 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <util/platform.h>
+#include <util/util_uint64.h>
+
+#include "plugin.h"
+#include "audio_buffer.h"
+
+#define NANO_SEC 1000000000ULL
+#define MILLI_NS 1000000ULL
+
+// How far the play-out clock may fall behind before it is re-based
+#define RESYNC_NS (200 * MILLI_NS)
+
+// How long without an underrun before the target depth shrinks again,
+// by 1/RELAX_DIV of what it grew over the base
+#define RELAX_NS (10 * NANO_SEC)
+#define RELAX_DIV 4
+
+void AudioJitterBuffer::reset(Decoder *d, uint32_t rate) {
+    if (decoder && samples_out) {
+        ilog("audio buffer: target=%dms underruns=%llu concealed=%llu trimmed=%llu resyncs=%llu",
+            target_ms, (unsigned long long) underruns, (unsigned long long) concealed,
+            (unsigned long long) trimmed, (unsigned long long) resyncs);
+    }
+
+    decoder = d;
+    sample_rate = rate;
+    frame_samples = 1024; // AAC-LC
+    primed = false;
+    ts_base = 0;
+    samples_out = 0;
+    last_adjust_ns = 0;
+    pts_base = 0;
+    pts_valid = false;
+    underrun = false;
+    target_ms = base_target_ms;
+    underruns = 0;
+    concealed = 0;
+    trimmed = 0;
+    resyncs = 0;
+}
+
+int AudioJitterBuffer::depth_ms(void) {
+    if (!decoder || !sample_rate)
+        return 0;
+
+    uint64_t samples = (uint64_t) decoder->decodeQueue.size() * frame_samples;
+    return (int) (samples * 1000 / sample_rate);
+}
+
+uint64_t AudioJitterBuffer::next_due(void) {
+    uint64_t now = os_gettime_ns();
+    if (target_ms < base_target_ms)
+        target_ms = base_target_ms;
+
+    if (!primed) {
+        if (depth_ms() < target_ms)
+            return 0;
+
+        dlog("audio buffer primed at %dms", depth_ms());
+        primed = true;
+        ts_base = now;
+        samples_out = 0;
+        last_adjust_ns = now;
+        return now;
+    }
+
+    uint64_t due = ts_base + util_mul_div64(samples_out, NANO_SEC, sample_rate);
+    if (now > due + RESYNC_NS) {
+        dlog("audio buffer: play-out fell behind by %llums",
+            (unsigned long long) ((now - due) / MILLI_NS));
+        ts_base += now - due;
+        due = now;
+        resyncs++;
+    }
+
+    return due;
+}
+
+DataPacket* AudioJitterBuffer::pull(void) {
+    DataPacket* packet;
+    const uint64_t now = os_gettime_ns();
+    const int limit = target_ms + (target_ms / 2) + frame_ms();
+
+    while (depth_ms() > limit && (packet = decoder->pull_ready_packet()) != NULL) {
+        decoder->push_empty_packet(packet);
+        trimmed++;
+    }
+
+    // One step deeper per underrun, however many frames it lasts: a
+    // long gap in the stream says little about the jitter
+    packet = decoder->pull_ready_packet();
+    if (!packet) {
+        concealed++;
+        last_adjust_ns = now;
+        if (!underrun) {
+            underrun = true;
+            underruns++;
+            if (target_ms < AUDIO_BUFFER_MAX_MS) {
+                target_ms += frame_ms();
+                if (target_ms > AUDIO_BUFFER_MAX_MS) target_ms = AUDIO_BUFFER_MAX_MS;
+                dlog("audio buffer underrun, target=%dms", target_ms);
+            }
+        }
+        return NULL;
+    }
+
+    underrun = false;
+    if (target_ms > base_target_ms && (now - last_adjust_ns) > RELAX_NS) {
+        int excess = target_ms - base_target_ms;
+        target_ms -= (excess + RELAX_DIV - 1) / RELAX_DIV;
+        last_adjust_ns = now;
+    }
+
+    return packet;
+}
+
+bool AudioJitterBuffer::conceal(struct obs_source_audio *frame) {
+    if (frame->format == AUDIO_FORMAT_UNKNOWN || frame->speakers == SPEAKERS_UNKNOWN)
+        return false;
+
+    const size_t planes = get_audio_planes(frame->format, frame->speakers);
+    const size_t channels = get_audio_channels(frame->speakers);
+    size_t size = get_audio_bytes_per_channel(frame->format) * frame_samples;
+    if (planes == 1) size *= channels;
+
+    if (silence_size < size) {
+        if (silence) bfree(silence);
+        silence = (uint8_t*) bzalloc(size);
+        silence_size = size;
+    }
+
+    for (size_t i = 0; i < MAX_AV_PLANES; i++)
+        frame->data[i] = (i < planes) ? silence : NULL;
+
+    frame->frames = frame_samples;
+    return true;
+}
+
+void AudioJitterBuffer::anchor(uint64_t pts) {
+    const int64_t played_us = (int64_t) util_mul_div64(samples_out, 1000000, sample_rate);
+    const int64_t frame_us = (int64_t) frame_samples * 1000000 / sample_rate;
+    const int64_t expected = pts_base + played_us;
+
+    if (!pts_valid || llabs((int64_t) pts - expected) > frame_us) {
+        pts_base = (int64_t) pts - played_us;
+        pts_valid = true;
+    }
+}
+
+uint64_t AudioJitterBuffer::advance(uint32_t frames) {
+    uint64_t ts = ts_base + util_mul_div64(samples_out, NANO_SEC, sample_rate);
+    if (clock && pts_valid) {
+        int64_t pts = pts_base + (int64_t) util_mul_div64(samples_out, 1000000, sample_rate);
+        uint64_t mapped = pts > 0 ? clock->map((uint64_t) pts) : 0;
+        if (mapped) ts = mapped;
+    }
+    samples_out += frames;
+    frame_samples = frames;
+    return ts;
+}
@@ -0,0 +1,80 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <obs.h>
+#include "decoder.h"
+#include "media_clock.h"
+
+#define AUDIO_BUFFER_MIN_MS 20
+#define AUDIO_BUFFER_MAX_MS 500
+#define AUDIO_BUFFER_DEFAULT_MS 60
+
+// Jitter buffer between the audio socket and the AAC decoder.
+// Compressed packets sit in the decoder's decodeQueue until the
+// buffer is primed to the target depth, then one frame is played
+// out per frame period. Output timestamps are derived from the
+// number of samples played out, not from the arrival time.
+// With a media clock attached, the sample count is anchored to the
+// packet pts and mapped onto the shared A/V clock.
+struct AudioJitterBuffer {
+    Decoder *decoder;
+    MediaClock *clock;
+    int base_target_ms;
+    int target_ms;
+    bool primed;
+
+    uint32_t sample_rate;
+    uint32_t frame_samples;
+    uint64_t ts_base;
+    uint64_t samples_out;
+    uint64_t last_adjust_ns;
+    int64_t pts_base;
+    bool pts_valid;
+    bool underrun;  // concealing since the last packet
+
+    uint8_t *silence;
+    size_t silence_size;
+
+    // stats
+    uint64_t underruns;  // episodes, of one or more concealed frames
+    uint64_t concealed;
+    uint64_t trimmed;
+    uint64_t resyncs;
+
+    AudioJitterBuffer(void) {
+        decoder = NULL;
+        clock = NULL;
+        base_target_ms = AUDIO_BUFFER_DEFAULT_MS;
+        target_ms = AUDIO_BUFFER_DEFAULT_MS;
+        silence = NULL;
+        silence_size = 0;
+        reset(NULL, 0);
+    }
+
+    ~AudioJitterBuffer(void) {
+        if (silence) bfree(silence);
+    }
+
+    void reset(Decoder *d, uint32_t rate);
+    int depth_ms(void);
+    inline int frame_ms(void) {
+        return sample_rate ? (int)(frame_samples * 1000 / sample_rate) : 0;
+    }
+
+    // Returns the wall clock time at which the next frame is due.
+    // Zero means the buffer is still priming.
+    uint64_t next_due(void);
+
+    // Take the next packet to decode, or NULL when the buffer ran dry
+    // and the caller should conceal with silence.
+    DataPacket* pull(void);
+
+    // Re-anchor the sample count to the pts of a pulled packet whenever
+    // they disagree (after trimming or concealment).
+    void anchor(uint64_t pts);
+
+    // Fill `frame` with one frame of silence in the current format.
+    bool conceal(struct obs_source_audio *frame);
+
+    // Stamp `frames` output samples and advance the play-out clock.
+    uint64_t advance(uint32_t frames);
+};
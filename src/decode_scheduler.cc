@@ -0,0 +1,206 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <util/threading.h>
+#include <util/platform.h>
+
+#include "plugin.h"
+#include "decode_scheduler.h"
+#include "thread_tuning.h"
+
+// Both conditions are waited on under the lock, and signalled with it
+// taken after the change, so no wakeup is lost between a check and the wait
+static std::mutex lock;
+static std::condition_variable work_cond;  // work queued, or shutdown
+static std::condition_variable idle_cond;  // a client is no longer busy
+static std::vector<DecodeClient*> clients;
+static pthread_t workers[DECODE_WORKERS_MAX];
+static int nb_workers = 0;
+static bool running = false;
+static size_t next_client = 0;
+
+// Pick the next client to run, round robin within a priority.
+// A picked client that has fallen behind while others outrank it sheds
+// its non-reference packets. Called with the lock held; the decoder is
+// picked up with it, a busy client's decoder is not swapped out.
+static DecodeClient *pick_client(Decoder **picked, bool *drop_low) {
+    DecodeClient *best = NULL;
+    size_t best_queued = 0;
+    size_t waiting = 0;
+    int top = -1;
+    const size_t count = clients.size();
+
+    for (size_t n = 0; n < count; n++) {
+        DecodeClient *client = clients[(next_client + n) % count];
+        Decoder *decoder = client->decoder;
+        if (!decoder)
+            continue;
+
+        if (client->priority > top)
+            top = client->priority;
+
+        size_t queued = decoder->decodeQueue.size();
+        if (queued == 0)
+            continue;
+
+        waiting += queued;
+        if (!client->busy && (!best || client->priority > best->priority)) {
+            best = client;
+            best_queued = queued;
+        }
+    }
+
+    if (!best)
+        return NULL;
+
+    next_client++;
+    best->busy = true;
+    *picked = best->decoder;
+    *drop_low = waiting > (size_t) nb_workers && best_queued > 1 && best->priority < top;
+    return best;
+}
+
+static void *worker_thread(void *data) {
+    (void) data;
+    DecodeClient *client;
+    DataPacket *packet;
+    Decoder *decoder;
+    bool drop_low;
+
+    // shared by all sources, so only the global default applies
+    struct ThreadState state;
+    thread_tuning_apply("droidcam-dec", &thread_defaults, &state);
+
+    while (1) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            client = NULL;
+            work_cond.wait(guard, [&] {
+                return !running || (client = pick_client(&decoder, &drop_low)) != NULL;
+            });
+            if (!client)
+                break;
+        }
+
+        if ((packet = decoder->pull_ready_packet()) != NULL) {
+            if (drop_low && !decoder->is_reference(packet)) {
+                client->dropped++;
+            } else {
+                client->decode(client->data, decoder, packet);
+                client->decoded++;
+            }
+            decoder->push_empty_packet(packet);
+        }
+
+        lock.lock();
+        client->busy = false;
+        lock.unlock();
+        idle_cond.notify_all();
+    }
+
+    return NULL;
+}
+
+static bool start_workers(void) {
+    int count = os_get_logical_cores();
+    if (count > DECODE_WORKERS_MAX) count = DECODE_WORKERS_MAX;
+    if (count < 1) count = 1;
+
+    running = true;
+    for (nb_workers = 0; nb_workers < count; nb_workers++) {
+        if (pthread_create(&workers[nb_workers], NULL, worker_thread, NULL) != 0)
+            break;
+    }
+
+    if (nb_workers == 0) {
+        elog("decode scheduler: error creating workers");
+        running = false;
+        return false;
+    }
+
+    ilog("decode scheduler: %d workers", nb_workers);
+    return true;
+}
+
+bool decode_scheduler_add(DecodeClient *client) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!running && !start_workers())
+        return false;
+
+    client->busy = false;
+    client->decoded = 0;
+    client->dropped = 0;
+    clients.push_back(client);
+    return true;
+}
+
+void decode_scheduler_remove(DecodeClient *client) {
+    lock.lock();
+    for (size_t i = 0; i < clients.size(); i++) {
+        if (clients[i] == client) {
+            clients.erase(clients.begin() + i);
+            break;
+        }
+    }
+    lock.unlock();
+
+    // no new picks after this, wait out the one in progress
+    decode_scheduler_idle(client);
+}
+
+void decode_scheduler_idle(DecodeClient *client) {
+    std::unique_lock<std::mutex> guard(lock);
+    idle_cond.wait(guard, [client] { return !client->busy; });
+}
+
+void decode_scheduler_set_decoder(DecodeClient *client, Decoder *decoder) {
+    lock.lock();
+    client->decoder = decoder;
+    lock.unlock();
+
+    decode_scheduler_idle(client);
+}
+
+// The packet is already on the decoder's queue; taking the lock orders
+// this after any worker's check of it
+void decode_scheduler_signal(void) {
+    lock.lock();
+    lock.unlock();
+    work_cond.notify_one();
+}
+
+int decode_scheduler_workers(void) {
+    return nb_workers;
+}
+
+// The workers stay up once started, idle ones just wait for work
+void decode_scheduler_shutdown(void) {
+    lock.lock();
+    const bool was_running = running;
+    running = false;
+    lock.unlock();
+
+    if (!was_running)
+        return;
+
+    work_cond.notify_all();
+    for (int i = 0; i < nb_workers; i++)
+        pthread_join(workers[i], NULL);
+    nb_workers = 0;
+}
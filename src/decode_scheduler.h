@@ -0,0 +1,54 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <stdint.h>
+#include "decoder.h"
+
+#define DECODE_WORKERS_MAX 8
+
+enum DecodePriority {
+    DECODE_HIDDEN,
+    DECODE_VISIBLE,
+    DECODE_PREVIEW,
+    DECODE_PROGRAM,
+};
+
+// A source's video decoding, as seen by the shared decode scheduler.
+// The run queue is the decoder's decodeQueue. A client is only ever on
+// one worker at a time, so its packets are decoded in order.
+struct DecodeClient {
+    // Decode one packet; the scheduler returns it to the decoder after
+    void (*decode)(void *data, Decoder *decoder, DataPacket *packet);
+    void *data;
+    volatile int priority;      // DecodePriority
+
+    // guarded by the scheduler lock
+    Decoder *decoder;           // the source's current decoder, may be NULL
+    bool busy;
+
+    // stats
+    uint64_t decoded;
+    uint64_t dropped;
+};
+
+// Process-wide pool of decode workers shared by all sources.
+// Idle workers take the highest priority client with work waiting, so
+// no core sits idle while any source has a backlog. When there are more
+// packets waiting than workers, lower priority sources that have fallen
+// behind drop the packets nothing depends on.
+bool decode_scheduler_add(DecodeClient *client);
+void decode_scheduler_remove(DecodeClient *client);
+
+// New work was queued
+void decode_scheduler_signal(void);
+
+// Wait until no worker is using the client's decoder
+void decode_scheduler_idle(DecodeClient *client);
+
+// Replace the client's decoder. Returns once no worker is using the
+// previous one, which can then be freed.
+void decode_scheduler_set_decoder(DecodeClient *client, Decoder *decoder);
+
+int decode_scheduler_workers(void);
+
+// Module unload, after all sources are gone
+void decode_scheduler_shutdown(void);
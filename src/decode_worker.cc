@@ -0,0 +1,237 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <util/platform.h>
+
+#include "plugin.h"
+#include "decode_worker.h"
+
+#if __linux__
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+DecodeWorker::~DecodeWorker(void) {
+    stop();
+    if (ring) munmap(ring, shm_ring_size());
+    if (shm_fd >= 0) close(shm_fd);
+}
+
+// Created once, kept across workers. Pages are only backed once written.
+bool DecodeWorker::map_ring(void) {
+    if (ring)
+        return true;
+
+    shm_fd = memfd_create("droidcam-frames", MFD_CLOEXEC);
+    if (shm_fd < 0) {
+        elog("worker: memfd_create(): %s", strerror(errno));
+        return false;
+    }
+
+    if (ftruncate(shm_fd, (off_t) shm_ring_size()) < 0) {
+        elog("worker: ftruncate(): %s", strerror(errno));
+        goto FAILED;
+    }
+
+    ring = (ShmRing*) mmap(NULL, shm_ring_size(), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (ring == MAP_FAILED) {
+        elog("worker: mmap(): %s", strerror(errno));
+        ring = NULL;
+        goto FAILED;
+    }
+
+    return true;
+
+FAILED:
+    close(shm_fd);
+    shm_fd = -1;
+    return false;
+}
+
+// posix_spawn rather than fork: nothing of OBS is copied or runs in the
+// child. The worker closes the other descriptors it inherits and ties
+// itself to this process (see worker/main.cc).
+bool DecodeWorker::start(const char *exe, socket_t sock, int format, bool use_hw, int mjpeg_backend) {
+    char arg_format[16], arg_hw[16], arg_mjpeg[16], arg_parent[16];
+    char *const argv[] = {(char*) exe, arg_format, arg_hw, arg_mjpeg, arg_parent, NULL};
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t signals;
+    pid_t child;
+    int s, m, err;
+
+    stop();
+    if (!map_ring())
+        return false;
+
+    shm_ring_reset(ring);
+    next = 0;
+    holding = false;
+
+    snprintf(arg_format, sizeof(arg_format), "%d", format);
+    snprintf(arg_hw, sizeof(arg_hw), "%d", use_hw ? 1 : 0);
+    snprintf(arg_mjpeg, sizeof(arg_mjpeg), "%d", mjpeg_backend);
+    snprintf(arg_parent, sizeof(arg_parent), "%d", (int) getpid());
+
+    // Above the target descriptors, so neither dup2 clobbers the other's
+    // source. dup2 clears close-on-exec on the targets.
+    s = fcntl(sock, F_DUPFD_CLOEXEC, WORKER_SHM_FD + 1);
+    m = fcntl(shm_fd, F_DUPFD_CLOEXEC, WORKER_SHM_FD + 1);
+    if (s < 0 || m < 0) {
+        elog("worker: fcntl(): %s", strerror(errno));
+        if (s >= 0) close(s);
+        if (m >= 0) close(m);
+        return false;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, s, WORKER_SOCK_FD);
+    posix_spawn_file_actions_adddup2(&actions, m, WORKER_SHM_FD);
+
+    // OBS's signal mask and handlers are not the worker's
+    posix_spawnattr_init(&attr);
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals);
+    sigfillset(&signals);
+    posix_spawnattr_setsigdefault(&attr, &signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    err = posix_spawn(&child, exe, &actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(s);
+    close(m);
+
+    if (err != 0) {
+        elog("worker: posix_spawn(%s): %s", exe, strerror(err));
+        pid = -1;
+        return false;
+    }
+
+    pid = (int) child;
+    started++;
+    ilog("worker: started %s pid %d", exe, pid);
+    return true;
+}
+
+void DecodeWorker::stop(void) {
+    if (pid <= 0)
+        return;
+
+    // Nothing to flush in the worker, and it may be stuck in a recv
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    dlog("worker: stopped pid %d", pid);
+    pid = -1;
+}
+
+bool DecodeWorker::alive(void) {
+    int status;
+    if (pid <= 0)
+        return false;
+
+    const int r = (int) waitpid(pid, &status, WNOHANG);
+    if (r == 0)
+        return true;
+
+    if (r < 0) {
+        elog("worker: waitpid(): %s", strerror(errno));
+        last_exit = -1;
+    }
+    else if (WIFSIGNALED(status)) {
+        const uint64_t now = os_gettime_ns();
+        if (window_crashes == 0 || now - crash_ns > WORKER_CRASH_WINDOW_NS) {
+            window_crashes = 0;
+            crash_ns = now;
+        }
+
+        window_crashes++;
+        crashes++;
+        last_exit = -WTERMSIG(status);
+        elog("worker: pid %d crashed on signal %d (%s)", pid, WTERMSIG(status),
+            strsignal(WTERMSIG(status)));
+    }
+    else {
+        last_exit = WEXITSTATUS(status);
+        ilog("worker: pid %d exited with %d", pid, last_exit);
+    }
+
+    pid = -1;
+    return false;
+}
+
+bool DecodeWorker::should_restart(void) {
+    return last_exit < 0 && window_crashes <= WORKER_CRASH_BUDGET;
+}
+
+bool DecodeWorker::next_frame(struct obs_source_frame2 *frame, uint64_t *pts, uint64_t *recv_ns,
+    int timeout_ms)
+{
+    if (!ring || !shm_ring_wait(ring, next, timeout_ms))
+        return false;
+
+    // The previous frame has been output by now, its slot can go
+    if (holding)
+        shm_ring_release(ring, next);
+
+    ShmSlot *slot = &ring->slots[next % SHM_RING_SLOTS];
+    uint8_t *base = shm_slot_data(ring, next);
+
+    *frame = slot->frame;
+    for (int i = 0; i < MAX_AV_PLANES; i++)
+        frame->data[i] = slot->frame.data[i] ? base + slot->offset[i] : NULL;
+
+    *pts = slot->pts;
+    *recv_ns = slot->recv_ns;
+    next++;
+    holding = true;
+    return true;
+}
+
+#else // no worker
+
+DecodeWorker::~DecodeWorker(void) {}
+
+bool DecodeWorker::map_ring(void) {
+    return false;
+}
+
+bool DecodeWorker::start(const char*, socket_t, int, bool, int) {
+    elog("worker: out of process decoding is not supported on this platform");
+    return false;
+}
+
+void DecodeWorker::stop(void) {}
+
+bool DecodeWorker::alive(void) {
+    return false;
+}
+
+bool DecodeWorker::should_restart(void) {
+    return false;
+}
+
+bool DecodeWorker::next_frame(struct obs_source_frame2*, uint64_t*, uint64_t*, int) {
+    return false;
+}
+
+#endif
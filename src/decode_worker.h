@@ -0,0 +1,82 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <stdint.h>
+#include <obs.h>
+
+#include "net.h"
+#include "shm_ring.h"
+
+#define WORKER_EXE "droidcam-worker"
+#define WORKER_SOCK_FD 3
+#define WORKER_SHM_FD 4
+
+// Exit codes of the worker
+#define WORKER_EXIT_STREAM 0    // stream ended or errored
+#define WORKER_EXIT_SETUP 1     // bad arguments or shared memory
+#define WORKER_EXIT_DECODE 2    // decoder failed, or gave up on errors
+
+// Crashes allowed in WORKER_CRASH_WINDOW_NS before restarts slow down
+#define WORKER_CRASH_BUDGET 3
+#define WORKER_CRASH_WINDOW_NS (30 * 1000000000ULL)
+
+// Out of process video decoding (Linux only).
+//
+// The worker is the droidcam-worker program, started for each video
+// connection with the connected socket and the frame ring. It reads the
+// stream and decodes it with the same code the plugin uses in process,
+// and publishes the planes to the ring. A decoder crash takes down the
+// worker only; the plugin sees it exit and reconnects with a new one.
+//
+// The plugin reads frames straight from the ring: the slot of the last
+// frame output stays in use until the next one is taken, so it can
+// still be copied for the last frame hold after the worker is gone.
+struct DecodeWorker {
+    int pid;
+    int shm_fd;
+    ShmRing *ring;
+    uint32_t next;      // next frame to read
+    bool holding;       // frame next-1 is in use
+
+    // stats
+    uint64_t started;
+    uint64_t crashes;
+    uint64_t crash_ns;  // start of the current crash window
+    int window_crashes;
+    int last_exit;
+
+    DecodeWorker(void) {
+        pid = -1;
+        shm_fd = -1;
+        ring = NULL;
+        next = 0;
+        holding = false;
+        started = 0;
+        crashes = 0;
+        crash_ns = 0;
+        window_crashes = 0;
+        last_exit = 0;
+    }
+
+    ~DecodeWorker(void);
+
+    bool running(void) { return pid > 0; }
+
+    // Start a worker on the connected video socket. The socket stays
+    // open in the plugin too, but is only read by the worker.
+    bool start(const char *exe, socket_t sock, int format, bool use_hw, int mjpeg_backend);
+    void stop(void);
+
+    // false once the worker has exited, which is then reaped
+    bool alive(void);
+
+    // Wait for the next frame and point `frame` at its planes.
+    // false on timeout, or when the worker is gone.
+    bool next_frame(struct obs_source_frame2 *frame, uint64_t *pts, uint64_t *recv_ns,
+        int timeout_ms);
+
+    // The last exit was a crash, with restarts still within budget
+    bool should_restart(void);
+
+    // internal
+    bool map_ring(void);
+};
@@ -16,6 +16,11 @@ struct Queue {
         items_lock.unlock();
     }
 
+    size_t size(void) {
+        std::lock_guard<std::mutex> guard(items_lock);
+        return items.size();
+    }
+
     T next_item(void) {
         T item{};
         if (items.size()) {
@@ -33,10 +38,16 @@ struct DataPacket {
     size_t size;
     size_t used;
     uint64_t pts;
+    uint64_t recv_ns; // local time the packet was fully received
+    bool skip_output; // decode for reference only, no output
+    bool new_config;  // starts with a codec config unlike the previous one
 
     DataPacket(size_t new_size) {
         size = 0;
         data = 0;
+        recv_ns = 0;
+        skip_output = false;
+        new_config = false;
         resize(new_size);
     }
 
@@ -56,11 +67,13 @@ struct Decoder {
     Queue<DataPacket*> recieveQueue;
     Queue<DataPacket*> decodeQueue;
     size_t alloc_count;
+    uint64_t dropped; // discarded to catch up
     volatile bool ready;
     volatile bool failed;
 
     Decoder(void) {
         alloc_count = 0;
+        dropped = 0;
         ready = false;
         failed = false;
     }
@@ -93,6 +106,8 @@ struct Decoder {
             packet->resize(size);
         }
         packet->used = 0;
+        packet->skip_output = false;
+        packet->new_config = false;
         return packet;
     }
 
@@ -100,6 +115,29 @@ struct Decoder {
         recieveQueue.add_item(packet);
     }
 
+    // Packets waiting to be decoded, and how long the oldest has waited
+    size_t queued(uint64_t now, uint64_t *wait_ns) {
+        std::lock_guard<std::mutex> guard(decodeQueue.items_lock);
+        *wait_ns = 0;
+        if (decodeQueue.items.size()) {
+            uint64_t recv_ns = decodeQueue.items.front()->recv_ns;
+            if (recv_ns && now > recv_ns) *wait_ns = now - recv_ns;
+        }
+        return decodeQueue.items.size();
+    }
+
+    // Drop decoder state, eg. for new stream parameters
+    virtual void flush(void) {}
+    // Start over with a fresh codec, same settings, primed with the last
+    // codec config seen (SPS/PPS) if any. false leaves it unusable
+    virtual bool reopen(const uint8_t*, size_t) { return true; }
+
+    // Decoder specific line for the source stats, snprintf style
+    virtual int print_stats(char *buf, size_t size) { (void) buf; (void) size; return 0; }
+
+    virtual bool is_keyframe(DataPacket*) { return true; }
+    // false if no later frame depends on this packet
+    virtual bool is_reference(DataPacket*) { return true; }
     virtual void push_ready_packet(DataPacket*) = 0;
     virtual bool decode_video(struct obs_source_frame2*, DataPacket*, bool *got_output) = 0;
     virtual bool decode_audio(struct obs_source_audio*, DataPacket*, bool *got_output) = 0;
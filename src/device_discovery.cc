@@ -372,6 +372,71 @@ void AdbMgr::ClearForwards(Device *dev) {
     return;
 }
 
+#define ADB_SERVER_PORT 5037
+
+// Send one adb server request and wait for its OKAY
+static bool adb_request(socket_t sock, const char *request) {
+    char buf[128];
+    char status[4];
+    int len = snprintf(buf, sizeof(buf), "%04x%s", (int) strlen(request), request);
+
+    if (net_send_all(sock, buf, len) <= 0) {
+        elog("adb: error sending %s", request);
+        return false;
+    }
+
+    if (net_recv_all(sock, status, 4) != 4) {
+        elog("adb: no reply to %s", request);
+        return false;
+    }
+
+    if (memcmp(status, "OKAY", 4) == 0)
+        return true;
+
+    // FAIL, then the message length in hex and the message
+    len = 0;
+    if (memcmp(status, "FAIL", 4) == 0 && net_recv_all(sock, buf, 4) == 4) {
+        buf[4] = 0;
+        len = (int) strtol(buf, NULL, 16);
+        if (len >= (int) sizeof(buf)) len = sizeof(buf) - 1;
+        if (len > 0 && net_recv_all(sock, buf, len) != len) len = 0;
+    }
+
+    elog("adb: %s failed: %.*s", request, len, buf);
+    return false;
+}
+
+socket_t AdbMgr::Connect(Device *dev, int remote_port) {
+    char request[128];
+    int server_port = ADB_SERVER_PORT;
+    socket_t sock;
+
+    if (disabled) // adb.exe was not found
+        return INVALID_SOCKET;
+
+    const char *env = getenv("ANDROID_ADB_SERVER_PORT");
+    if (env && atoi(env) > 0)
+        server_port = atoi(env);
+
+    sock = net_connect(localhost_ip, server_port);
+    if (sock == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    snprintf(request, sizeof(request), "host:transport:%s", dev->serial);
+    if (!adb_request(sock, request))
+        goto FAILED;
+
+    snprintf(request, sizeof(request), "tcp:%d", remote_port);
+    if (!adb_request(sock, request))
+        goto FAILED;
+
+    return sock;
+
+FAILED:
+    net_close(sock);
+    return INVALID_SOCKET;
+}
+
 // MARK: USBMUX
 
 USBMux::USBMux() : iproxy(this) {
@@ -621,10 +686,23 @@ socket_t USBMux::Connect(Device* dev, int port, int* iproxy_port) {
         return INVALID_SOCKET;
     }
 
-    set_nonblock(rc, 0);
-    set_recv_timeout(rc, 5);
+    // The usbmuxd fd is handed to the stream threads as is, saving the
+    // relay hop. If it does not take socket options, go through the proxy.
+    if (!set_nonblock(rc, 0) || set_recv_timeout(rc, 5) != 0) {
+        elog("usbmuxd socket not usable directly, using proxy");
+        usbmuxd_disconnect(rc);
+
+        int local_port = iproxy.Start(dev, port);
+        if (iproxy_port) *iproxy_port = local_port;
+        if (local_port <= 0)
+            return INVALID_SOCKET;
+
+        return net_connect(localhost_ip, local_port);
+    }
 
-    *iproxy_port = iproxy.Start(dev, port);
+    // The proxy then only serves the web control link
+    if (iproxy_port)
+        *iproxy_port = iproxy.Start(dev, port);
 
     return rc;
 
@@ -90,6 +90,25 @@ struct MDNS : DeviceDiscovery {
     void DoReload();
 };
 
+// MARK: WiFi subnet scan
+// For networks that block multicast: connect to the app port on every
+// address of the local subnets (a /24 at most each), a bounded number at
+// a time, and keep those that answer /ping. Hits are WiFi devices.
+struct SubnetScan : DeviceDiscovery {
+    const char* suffix = "WIFI";
+    int port;
+    char subnet[64];    // "a.b.c.d/n" to scan instead of the local subnets
+
+    // last scan
+    int probed;
+    int found;
+    int elapsed_ms;
+
+    SubnetScan();
+    void DoReload();
+    void AddHit(uint32_t addr);
+};
+
 
 
 // MARK: Android USB
@@ -101,6 +120,8 @@ struct AdbMgr : DeviceDiscovery {
     ~AdbMgr();
     void DoReload();
 
+    // Stream to the device port through the adb server, no forward needed
+    socket_t Connect(Device* dev, int remote_port);
     bool AddForward(Device* dev, int local_port, int remote_port);
     void ClearForwards(Device* dev);
     void GetModel(Device* dev);
@@ -156,5 +177,6 @@ struct USBMux : DeviceDiscovery {
     ~USBMux();
     void DoReload();
     void GetModel(Device* dev);
+    // `iproxy_port` (optional) receives the local proxy port
     socket_t Connect(Device* dev, int port, int* iproxy_port);
 };
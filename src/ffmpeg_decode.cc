@@ -147,6 +147,11 @@ int FFMpegDecoder::init(uint8_t* header, enum AVCodecID id, bool use_hw)
 		init_hw_decoder(this);
 	}
 
+	if (frame_threads > 1) {
+		decoder->thread_count = frame_threads;
+		decoder->thread_type = FF_THREAD_FRAME;
+	}
+
 	ret = avcodec_open2(decoder, codec, NULL);
 	if (ret < 0) {
 		return ret;
@@ -156,8 +161,10 @@ int FFMpegDecoder::init(uint8_t* header, enum AVCodecID id, bool use_hw)
 	// 	decoder->flags |= CODEC_FLAG_TRUNC;
 	decoder->flags |= AV_CODEC_FLAG_LOW_DELAY;
 	decoder->flags2 |= AV_CODEC_FLAG2_FAST;
-	// decoder->flags2 |= AV_CODEC_FLAG2_CHUNKS;
-	decoder->thread_type = FF_THREAD_SLICE;
+	if (chunks)
+		decoder->flags2 |= AV_CODEC_FLAG2_CHUNKS;
+	if (frame_threads <= 1)
+		decoder->thread_type = FF_THREAD_SLICE;
 
 	frame = av_frame_alloc();
 	if (!frame)
@@ -177,6 +184,11 @@ int FFMpegDecoder::init(uint8_t* header, enum AVCodecID id, bool use_hw)
 }
 
 FFMpegDecoder::~FFMpegDecoder(void)
+{
+	release();
+}
+
+void FFMpegDecoder::release(void)
 {
 	if (frame_hw)
 		av_frame_free(&frame_hw);
@@ -194,6 +206,42 @@ FFMpegDecoder::~FFMpegDecoder(void)
 		avcodec_free_context(&decoder);
 }
 
+void FFMpegDecoder::flush(void)
+{
+	if (decoder)
+		avcodec_flush_buffers(decoder);
+}
+
+// Video only: the AAC decoder needs its header to init
+bool FFMpegDecoder::reopen(const uint8_t *config, size_t size)
+{
+	const enum AVCodecID id = codec->id;
+	const bool use_hw = hw;
+
+	release();
+	ready = false;
+	hw = false;
+	hw_pix_fmt = AV_PIX_FMT_NONE;
+	catchup = false;
+	b_frame_check = false;
+
+	if (init(NULL, id, use_hw) < 0) {
+		elog("could not reopen decoder");
+		return false;
+	}
+
+	// keyframes don't always repeat the parameter sets
+	if (size) {
+		packet->data = (uint8_t*) config;
+		packet->size = (int) size;
+		packet->pts = AV_NOPTS_VALUE;
+		avcodec_send_packet(decoder, packet);
+	}
+
+	ilog("decoder reopened");
+	return true;
+}
+
 // TODO:
 // add AV_PIX_FMT_YUVJ420P to obs-ffmpeg-formats.h
 // add convert_color_space to obs-ffmpeg-formats.h
@@ -311,22 +359,45 @@ DataPacket* FFMpegDecoder::pull_empty_packet(size_t size)
 	return packet;
 }
 
+static inline uint8_t nal_header(DataPacket* packet)
+{
+	return packet->data[2] == 1 ? packet->data[3] : packet->data[4];
+}
+
+bool FFMpegDecoder::is_keyframe(DataPacket* packet)
+{
+	if (codec->id != AV_CODEC_ID_H264)
+		return true;
+
+	// P/B slices are below 5, anything higher (IDR, SPS, PPS) starts a GOP
+	int nalType = nal_header(packet) & 0x1f;
+	return nalType >= 5;
+}
+
+bool FFMpegDecoder::is_reference(DataPacket* packet)
+{
+	if (codec->id != AV_CODEC_ID_H264)
+		return true;
+
+	// nal_ref_idc == 0: nothing references this slice
+	return (nal_header(packet) & 0x60) != 0;
+}
+
 void FFMpegDecoder::push_ready_packet(DataPacket* packet)
 {
 	if (catchup) {
 		if (decodeQueue.items.size() > 0){
 			recieveQueue.add_item(packet);
+			dropped++;
 			return;
 		}
 
 		// Discard P/B frames and continue on anything higher
-		if (codec->id == AV_CODEC_ID_H264) {
-			int nalType = packet->data[2] == 1 ? (packet->data[3] & 0x1f) : (packet->data[4] & 0x1f);
-			if (nalType < 5) {
-				dlog("discard non-keyframe");
-				recieveQueue.add_item(packet);
-				return;
-			}
+		if (!is_keyframe(packet)) {
+			dlog("discard non-keyframe");
+			recieveQueue.add_item(packet);
+			dropped++;
+			return;
 		}
 
 		ilog("decoder catchup: decodeQueue: %ld recieveQueue: %ld", decodeQueue.items.size(), recieveQueue.items.size());
@@ -347,25 +418,39 @@ void FFMpegDecoder::push_ready_packet(DataPacket* packet)
 
 bool FFMpegDecoder::decode_video(struct obs_source_frame2* obs_frame, DataPacket* data_packet,
 		bool *got_output)
+{
+	return decode_video_data(obs_frame, data_packet->data, data_packet->used,
+		data_packet->pts, data_packet->skip_output, got_output);
+}
+
+bool FFMpegDecoder::decode_video_data(struct obs_source_frame2* obs_frame, uint8_t *data, size_t size,
+		uint64_t pts, bool skip_output, bool *got_output)
 {
 	int ret;
 	AVFrame *out_frame;
 	*got_output = false;
 
-	packet->data = data_packet->data;
-	packet->size = data_packet->used;
-	packet->pts = (data_packet->pts == NO_PTS) ? AV_NOPTS_VALUE : data_packet->pts;
+	packet->data = data;
+	packet->size = (int) size;
+	packet->pts = (pts == NO_PTS) ? AV_NOPTS_VALUE : pts;
 
 	if (decoder->has_b_frames && !b_frame_check) {
 		elog("WARNING Stream has b-frames!");
 		b_frame_check = true;
 	}
 
+	// Frames decoded only to keep references intact (see FrameDecimator)
+	// skip the rest of the pipeline. Non-reference ones never get here.
 	ret = avcodec_send_packet(decoder, packet);
 	if (ret == 0) {
 		out_frame = hw ? frame_hw : frame;
 		ret = avcodec_receive_frame(decoder, out_frame);
-		if (ret == 0) goto GOT_FRAME;
+		if (ret == 0) {
+			if (skip_output)
+				return true;
+
+			goto GOT_FRAME;
+		}
 	}
 
 	return ret == AVERROR(EAGAIN);
@@ -54,6 +54,8 @@ struct FFMpegDecoder : Decoder {
 	bool hw;
 	bool catchup;
 	bool b_frame_check;
+	bool chunks; // input may be partial frames, see decode_video_data
+	int frame_threads; // > 1 for frame threading, output lags input by n-1
 
 	FFMpegDecoder(void) {
 		decoder = NULL;
@@ -65,16 +67,25 @@ struct FFMpegDecoder : Decoder {
 		hw = false;
 		catchup = false;
 		b_frame_check = false;
+		chunks = false;
+		frame_threads = 0;
 	}
 
 	~FFMpegDecoder(void);
 
 	int init(uint8_t* header, enum AVCodecID id, bool use_hw);
+	void release(void);
+	void flush(void);
+	bool reopen(const uint8_t *config, size_t size);
 	bool decode_video(struct obs_source_frame2*, DataPacket*, bool *got_output);
+	bool decode_video_data(struct obs_source_frame2*, uint8_t *data, size_t size,
+		uint64_t pts, bool skip_output, bool *got_output);
 
 	bool decode_audio(struct obs_source_audio*, DataPacket*, bool *got_output);
 
 	DataPacket* pull_empty_packet(size_t size);
+	bool is_keyframe(DataPacket*);
+	bool is_reference(DataPacket*);
 	void push_ready_packet(DataPacket*);
 };
 #endif
@@ -0,0 +1,95 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#ifndef __FRAME_DECIMATOR_H__
+#define __FRAME_DECIMATOR_H__
+
+#include <stdint.h>
+
+// Drops incoming video frames down to the OBS canvas rate.
+//
+// Works on phone pts (usec). The input frame interval is estimated from
+// pts deltas and decimation only engages when the phone is clearly
+// faster than the canvas. Kept frames are re-stamped onto an even grid
+// at the canvas interval, so the output cadence does not beat against
+// the input rate (eg. 50 -> 30 fps).
+struct FrameDecimator {
+    uint64_t interval;      // usec, canvas frame interval, 0 = disabled
+    double input_interval;  // usec, smoothed
+    uint64_t last_pts;
+    uint64_t next_pts;
+    bool active;
+
+    // stats
+    uint64_t frames_in;
+    uint64_t frames_out;
+
+    FrameDecimator(void) {
+        interval = 0;
+        reset();
+    }
+
+    void reset(void) {
+        input_interval = 0;
+        last_pts = 0;
+        next_pts = 0;
+        active = false;
+        frames_in = 0;
+        frames_out = 0;
+    }
+
+    void set_rate(uint32_t fps_num, uint32_t fps_den) {
+        interval = fps_num ? (uint64_t) fps_den * 1000000 / fps_num : 0;
+        reset();
+    }
+
+    // Returns false if the frame should be dropped.
+    // Kept frames may have their pts moved onto the output grid.
+    bool keep(uint64_t *pts) {
+        const uint64_t slack = interval / 4;
+        frames_in++;
+
+        if (!interval)
+            goto KEEP;
+
+        if (last_pts && *pts > last_pts && (*pts - last_pts) < 1000000) {
+            const double d = (double) (*pts - last_pts);
+            input_interval = input_interval ? input_interval + (d - input_interval) / 8.0 : d;
+        } else {
+            // first frame or a discontinuity
+            next_pts = 0;
+        }
+        last_pts = *pts;
+
+        active = input_interval > 0 && input_interval < (double) interval * 0.9;
+        if (!active) {
+            next_pts = 0;
+            goto KEEP;
+        }
+
+        if (next_pts == 0 || *pts > next_pts + interval)
+            next_pts = *pts;
+
+        if (*pts + slack < next_pts)
+            return false;
+
+        *pts = next_pts;
+        next_pts += interval;
+
+        KEEP:
+        frames_out++;
+        return true;
+    }
+
+    inline double ratio(void) {
+        return frames_out ? (double) frames_in / (double) frames_out : 1.0;
+    }
+
+    inline double input_fps(void) {
+        return input_interval > 0 ? 1000000.0 / input_interval : 0;
+    }
+
+    inline double output_fps(void) {
+        return interval ? 1000000.0 / (double) interval : 0;
+    }
+};
+
+#endif
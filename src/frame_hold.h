@@ -0,0 +1,85 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <string.h>
+#include <obs.h>
+
+// Private copy of the last output video frame, so it can stay on screen
+// after the decoder (which owns the original buffers) is gone.
+// The buffer is reused and only grows, so a flaky link does not churn
+// allocations.
+struct FrameHold {
+    struct obs_source_frame2 frame;
+    uint8_t *buffer;
+    size_t buffer_size;
+    bool valid;
+
+    FrameHold(void) {
+        memset(&frame, 0, sizeof(frame));
+        buffer = NULL;
+        buffer_size = 0;
+        valid = false;
+    }
+
+    ~FrameHold(void) {
+        if (buffer) bfree(buffer);
+    }
+
+    static size_t plane_height(enum video_format format, int plane, uint32_t height) {
+        switch (format) {
+        case VIDEO_FORMAT_I420:
+            return plane == 0 ? height : (plane < 3 ? (height + 1) / 2 : 0);
+        case VIDEO_FORMAT_NV12:
+            return plane == 0 ? height : (plane == 1 ? (height + 1) / 2 : 0);
+        case VIDEO_FORMAT_I422:
+            return plane < 3 ? height : 0;
+        case VIDEO_FORMAT_YUY2:
+        case VIDEO_FORMAT_UYVY:
+        case VIDEO_FORMAT_RGBA:
+        case VIDEO_FORMAT_BGRA:
+        case VIDEO_FORMAT_BGRX:
+            return plane == 0 ? height : 0;
+        default:
+            return 0;
+        }
+    }
+
+    bool copy(const struct obs_source_frame2 *src) {
+        size_t sizes[MAX_AV_PLANES];
+        size_t total = 0;
+
+        valid = false;
+        if (src->format == VIDEO_FORMAT_NONE || !src->data[0])
+            return false;
+
+        for (int i = 0; i < MAX_AV_PLANES; i++) {
+            sizes[i] = src->data[i]
+                ? (size_t) src->linesize[i] * plane_height(src->format, i, src->height)
+                : 0;
+            total += sizes[i];
+        }
+
+        if (total == 0)
+            return false;
+
+        if (buffer_size < total) {
+            buffer = (uint8_t*) brealloc(buffer, total);
+            buffer_size = total;
+        }
+
+        frame = *src;
+        uint8_t *p = buffer;
+        for (int i = 0; i < MAX_AV_PLANES; i++) {
+            if (sizes[i] == 0) {
+                frame.data[i] = NULL;
+                continue;
+            }
+
+            memcpy(p, src->data[i], sizes[i]);
+            frame.data[i] = p;
+            p += sizes[i];
+        }
+
+        valid = true;
+        return true;
+    }
+};
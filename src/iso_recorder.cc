@@ -0,0 +1,583 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <obs.h>
+
+#include "plugin.h"
+#include "iso_recorder.h"
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+}
+
+// How long to wait for the audio config before recording video only
+#define AUDIO_WAIT_US (5 * 1000000ULL)
+
+static const AVRational usec_time_base = {1, 1000000};
+
+// Exp-Golomb reader over an H.264 RBSP
+struct BitReader {
+    const uint8_t *data;
+    size_t size;
+    size_t pos; // bits
+
+    unsigned bit(void) {
+        if (pos >= size * 8) { pos++; return 0; }
+        unsigned b = (data[pos >> 3] >> (7 - (pos & 7))) & 1;
+        pos++;
+        return b;
+    }
+
+    unsigned bits(int n) {
+        unsigned v = 0;
+        while (n--) v = (v << 1) | bit();
+        return v;
+    }
+
+    unsigned ue(void) {
+        int zeros = 0;
+        while (bit() == 0 && zeros < 32) zeros++;
+        return ((1u << zeros) - 1) + bits(zeros);
+    }
+
+    int se(void) {
+        unsigned v = ue();
+        return (v & 1) ? (int) ((v + 1) / 2) : -(int) (v / 2);
+    }
+
+    bool overrun(void) { return pos > size * 8; }
+};
+
+static void skip_scaling_list(BitReader *br, int count) {
+    int last = 8, next = 8;
+    for (int j = 0; j < count; j++) {
+        if (next != 0)
+            next = (last + br->se() + 256) % 256;
+        if (next != 0)
+            last = next;
+    }
+}
+
+// Cropped frame size from the SPS in an Annex B config
+static bool h264_sps_size(const uint8_t *data, size_t size, int *w, int *h) {
+    size_t start = 0;
+    for (size_t i = 0; i + 3 < size; i++) {
+        if (data[i] == 0 && data[i+1] == 0 && data[i+2] == 1 && (data[i+3] & 0x1f) == 7) {
+            start = i + 4;
+            break;
+        }
+    }
+    if (start == 0)
+        return false;
+
+    // RBSP, without emulation prevention bytes
+    uint8_t rbsp[ISO_CONFIG_MAX];
+    size_t len = 0, zeros = 0;
+    for (size_t i = start; i < size && len < sizeof(rbsp); i++) {
+        if (zeros >= 2 && data[i] == 3) { zeros = 0; continue; }
+        if (zeros >= 2 && data[i] <= 1) break; // next start code
+        zeros = (data[i] == 0) ? zeros + 1 : 0;
+        rbsp[len++] = data[i];
+    }
+
+    BitReader br = {rbsp, len, 0};
+    unsigned profile = br.bits(8);
+    br.bits(16); // constraint flags, level
+    br.ue();     // sps id
+
+    unsigned chroma_format = 1;
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44
+        || profile == 83 || profile == 86 || profile == 118 || profile == 128 || profile == 138
+        || profile == 139 || profile == 134 || profile == 135)
+    {
+        chroma_format = br.ue();
+        if (chroma_format == 3 && br.bit())
+            chroma_format = 0; // separate colour planes, cropped like monochrome
+        br.ue(); // bit depth luma
+        br.ue(); // bit depth chroma
+        br.bit();
+        if (br.bit()) {
+            for (int i = 0; i < (chroma_format != 3 ? 8 : 12); i++)
+                if (br.bit())
+                    skip_scaling_list(&br, i < 6 ? 16 : 64);
+        }
+    }
+
+    br.ue(); // log2 max frame num
+    unsigned poc_type = br.ue();
+    if (poc_type == 0) {
+        br.ue();
+    } else if (poc_type == 1) {
+        br.bit();
+        br.se();
+        br.se();
+        unsigned cycle = br.ue();
+        for (unsigned i = 0; i < cycle && !br.overrun(); i++)
+            br.se();
+    }
+
+    br.ue(); // max ref frames
+    br.bit();
+    unsigned mb_width = br.ue() + 1;
+    unsigned map_height = br.ue() + 1;
+    unsigned frame_mbs_only = br.bit();
+    if (!frame_mbs_only)
+        br.bit();
+    br.bit();
+
+    int width = (int) mb_width * 16;
+    int height = (int) ((2 - frame_mbs_only) * map_height * 16);
+    if (br.bit()) {
+        int crop_x = (chroma_format == 1 || chroma_format == 2) ? 2 : 1;
+        int crop_y = ((chroma_format == 1) ? 2 : 1) * (2 - frame_mbs_only);
+        unsigned left = br.ue(), right = br.ue(), top = br.ue(), bottom = br.ue();
+        width -= (int) (left + right) * crop_x;
+        height -= (int) (top + bottom) * crop_y;
+    }
+
+    if (br.overrun() || width <= 0 || height <= 0 || width > 8192 || height > 8192)
+        return false;
+
+    *w = width;
+    *h = height;
+    return true;
+}
+
+// Frame size from the SOF segment of a JPEG
+static bool jpeg_size(const uint8_t *data, size_t size, int *w, int *h) {
+    size_t p = 2;
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+
+    while (p + 4 <= size) {
+        if (data[p] != 0xFF) return false;
+        uint8_t marker = data[p + 1];
+        if (marker == 0xFF) { p++; continue; }
+        if (marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7)) { p += 2; continue; }
+        if (marker == 0xD9 || marker == 0xDA) return false;
+
+        size_t len = (data[p + 2] << 8) | data[p + 3];
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (p + 9 > size) return false;
+            *h = (data[p + 5] << 8) | data[p + 6];
+            *w = (data[p + 7] << 8) | data[p + 8];
+            return *w > 0 && *h > 0;
+        }
+        p += 2 + len;
+    }
+    return false;
+}
+
+// Close the file and carry on in `file` with the next packet
+static void split_file(IsoRecorder *r, const char *file) {
+    r->close();
+    ilog("iso recorder: new size or codec config, continuing in %s", file);
+    snprintf(r->path, sizeof(r->path), "%s", file);
+    r->failed = false;
+    r->pts_base = 0;
+    r->first_key_pts = 0;
+    r->last_ts[0] = r->last_ts[1] = -1;
+}
+
+static void *recorder_thread(void *data) {
+    IsoRecorder *r = (IsoRecorder*)(data);
+    std::vector<IsoPacket> batch;
+    char next_path[sizeof(r->path)];
+    size_t split_at = 0;
+    bool split;
+    bool done;
+
+    ilog("iso recorder start: %s", r->path);
+
+    do {
+        os_event_timedwait(r->signal, 100);
+
+        // the new stream is held until its frame size is known
+        r->lock.lock();
+        done = !r->running;
+        split = false;
+        if (!r->sizing || done) {
+            batch.swap(r->queue);
+            r->queued_bytes = 0;
+            split = r->split;
+            split_at = r->split_at;
+            r->split = false;
+            if (split) {
+                // taken: a later split needs a path of its own
+                snprintf(next_path, sizeof(next_path), "%s", r->next_path);
+                r->next_path[0] = 0;
+            }
+        }
+        r->lock.unlock();
+
+        // packets of the previous stream or config finish the old file
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (split && i == split_at) {
+                split_file(r, next_path);
+                split = false;
+            }
+
+            if (!r->failed)
+                r->mux(&batch[i]);
+
+            bfree(batch[i].data);
+        }
+        batch.clear();
+
+        if (split)
+            split_file(r, next_path);
+    } while (!done);
+
+    r->close();
+    ilog("iso recorder end: written=%llu dropped=%llu",
+        (unsigned long long) r->bytes_written, (unsigned long long) r->dropped);
+    return NULL;
+}
+
+void IsoRecorder::reset(const char *file, enum AVCodecID codec, int w, int h, bool audio) {
+    snprintf(path, sizeof(path), "%s", file);
+    has_video = (codec != AV_CODEC_ID_NONE);
+    has_audio = audio;
+    video_codec = codec;
+    width = w;
+    height = h;
+    video_config_size = 0;
+    video_gap = true;
+    joining = false;
+    pts_offset = 0;
+    last_pts = 0;
+    sizing = has_video;
+    split = false;
+    next_path[0] = 0;
+    failed = false;
+    pts_base = 0;
+    first_key_pts = 0;
+    last_ts[0] = last_ts[1] = -1;
+    bytes_written = 0;
+    dropped = 0;
+}
+
+bool IsoRecorder::start(const char *file, enum AVCodecID codec, int w, int h, bool audio) {
+    if (running)
+        stop();
+
+    reset(file, codec, 0, 0, audio);
+    req_width = w;
+    req_height = h;
+
+    if (!signal && os_event_init(&signal, OS_EVENT_TYPE_AUTO) != 0) {
+        elog("iso recorder: error creating event");
+        signal = NULL;
+        return false;
+    }
+
+    running = true;
+    if (pthread_create(&thread, NULL, recorder_thread, this) != 0) {
+        elog("iso recorder: error creating thread");
+        running = false;
+        return false;
+    }
+
+    return true;
+}
+
+void IsoRecorder::stop(void) {
+    if (!running)
+        return;
+
+    lock.lock();
+    running = false;
+    lock.unlock();
+
+    os_event_signal(signal);
+    pthread_join(thread, NULL);
+}
+
+void IsoRecorder::resume(const char *file, int w, int h) {
+    std::lock_guard<std::mutex> guard(lock);
+    snprintf(next_path, sizeof(next_path), "%s", file);
+    req_width = w;
+    req_height = h;
+    joining = true;
+    video_gap = true;
+    sizing = has_video;
+}
+
+// A file has a single config, a new one needs a new file. The caller
+// gives its path with resume() first.
+void IsoRecorder::set_video_config(const uint8_t *data, size_t size) {
+    if (size > sizeof(video_config))
+        return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (video_config_size && (size != video_config_size || memcmp(video_config, data, size) != 0)) {
+        if (!next_path[0])
+            elog("iso recorder: codec config changed with no new file to go to");
+        else if (!split) {
+            split = true;
+            split_at = queue.size();
+        }
+    }
+
+    memcpy(video_config, data, size);
+    video_config_size = size;
+
+    if (sizing && video_codec == AV_CODEC_ID_H264) {
+        int w, h;
+        if (h264_sps_size(data, size, &w, &h))
+            set_video_size(w, h);
+        else
+            set_video_size(req_width, req_height);
+    }
+}
+
+void IsoRecorder::set_video_size(int w, int h) {
+    if (!sizing)
+        return;
+
+    if (width && (w != width || h != height) && next_path[0] && !split) {
+        split = true;
+        split_at = queue.size();
+    }
+
+    width = w;
+    height = h;
+    sizing = false;
+    if (running)
+        os_event_signal(signal);
+}
+
+void IsoRecorder::set_audio_config(const uint8_t *data, size_t size, int rate, int nb_channels) {
+    if (size > sizeof(audio_config))
+        return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    memcpy(audio_config, data, size);
+    audio_config_size = size;
+    sample_rate = rate;
+    channels = nb_channels;
+}
+
+void IsoRecorder::write(const uint8_t *data, size_t size, uint64_t pts, bool video, bool keyframe) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!running || failed)
+        return;
+
+    if (video && video_gap) {
+        if (!keyframe) {
+            dropped++;
+            return;
+        }
+        video_gap = false;
+    }
+
+    // H.264 is sized from its config, which comes first; MJPEG frames carry their own
+    if (video && sizing) {
+        int w, h;
+        if (video_codec == AV_CODEC_ID_MJPEG && jpeg_size(data, size, &w, &h))
+            set_video_size(w, h);
+        else
+            set_video_size(req_width, req_height);
+    }
+
+    if (joining) {
+        if (has_video && !video) {
+            dropped++;
+            return;
+        }
+
+        pts_offset = (int64_t) (last_pts + ISO_JOIN_GAP_US) - (int64_t) pts;
+        joining = false;
+    }
+
+    pts = (uint64_t) ((int64_t) pts + pts_offset);
+    if (pts > last_pts)
+        last_pts = pts;
+
+    if (queued_bytes + size > ISO_BUFFER_MAX) {
+        // disk can't keep up; video must restart on a keyframe
+        if (video) video_gap = true;
+        dropped++;
+        return;
+    }
+
+    IsoPacket p;
+    p.data = (uint8_t*) bmalloc(size);
+    memcpy(p.data, data, size);
+    p.size = size;
+    p.pts = pts;
+    p.video = video;
+    p.keyframe = keyframe;
+
+    queue.push_back(p);
+    queued_bytes += size;
+    os_event_signal(signal);
+}
+
+static void set_extradata(AVCodecParameters *par, const uint8_t *data, size_t size) {
+    par->extradata = (uint8_t*) av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    memcpy(par->extradata, data, size);
+    par->extradata_size = (int) size;
+}
+
+bool IsoRecorder::open(IsoPacket *p) {
+    int ret;
+    std::unique_lock<std::mutex> guard(lock);
+
+    if (has_video) {
+        // start on a keyframe with the SPS/PPS and size known
+        if (!p->video || !p->keyframe || width == 0)
+            return false;
+
+        if (video_codec == AV_CODEC_ID_H264 && video_config_size == 0)
+            return false;
+
+        if (has_audio && audio_config_size == 0) {
+            if (first_key_pts == 0)
+                first_key_pts = p->pts;
+
+            if (p->pts - first_key_pts < AUDIO_WAIT_US)
+                return false;
+
+            ilog("iso recorder: no audio config, recording video only");
+            has_audio = false;
+        }
+    }
+    else if (p->video || audio_config_size == 0) {
+        return false;
+    }
+
+    ret = avformat_alloc_output_context2(&ctx, NULL, NULL, path);
+    if (ret < 0 || !ctx) {
+        elog("iso recorder: unsupported output %s", path);
+        goto FAILED;
+    }
+
+    video_stream = NULL;
+    audio_stream = NULL;
+
+    if (has_video) {
+        video_stream = avformat_new_stream(ctx, NULL);
+        AVCodecParameters *par = video_stream->codecpar;
+        par->codec_type = AVMEDIA_TYPE_VIDEO;
+        par->codec_id = video_codec;
+        par->width = width;
+        par->height = height;
+        if (video_config_size)
+            set_extradata(par, video_config, video_config_size);
+
+        video_stream->time_base = usec_time_base;
+    }
+
+    if (has_audio) {
+        audio_stream = avformat_new_stream(ctx, NULL);
+        AVCodecParameters *par = audio_stream->codecpar;
+        par->codec_type = AVMEDIA_TYPE_AUDIO;
+        par->codec_id = AV_CODEC_ID_AAC;
+        par->sample_rate = sample_rate;
+        par->frame_size = 1024;
+        #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59, 24, 100)
+        par->channels = channels;
+        par->channel_layout = av_get_default_channel_layout(channels);
+        #else
+        av_channel_layout_default(&par->ch_layout, channels);
+        #endif
+        set_extradata(par, audio_config, audio_config_size);
+
+        audio_stream->time_base = usec_time_base;
+    }
+    guard.unlock();
+
+    if (!(ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&ctx->pb, path, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            elog("iso recorder: could not open %s: %d", path, ret);
+            goto FAILED;
+        }
+    }
+
+    ret = avformat_write_header(ctx, NULL);
+    if (ret < 0) {
+        elog("iso recorder: error writing header: %d", ret);
+        goto FAILED;
+    }
+
+    packet = av_packet_alloc();
+    pts_base = p->pts;
+    ilog("iso recorder: recording video=%d audio=%d to %s",
+        video_stream != NULL, audio_stream != NULL, path);
+    return true;
+
+FAILED:
+    if (guard.owns_lock()) guard.unlock();
+    close();
+    failed = true;
+    return false;
+}
+
+void IsoRecorder::mux(IsoPacket *p) {
+    if (!packet && !open(p))
+        return;
+
+    AVStream *stream = p->video ? video_stream : audio_stream;
+    if (!stream || p->pts < pts_base)
+        return;
+
+    // muxers require strictly increasing timestamps per stream
+    int64_t ts = (int64_t) (p->pts - pts_base);
+    int64_t *last = &last_ts[p->video ? 0 : 1];
+    if (ts <= *last) ts = *last + 1;
+    *last = ts;
+
+    packet->data = p->data;
+    packet->size = (int) p->size;
+    packet->stream_index = stream->index;
+    packet->flags = p->keyframe ? AV_PKT_FLAG_KEY : 0;
+    packet->pts = ts;
+    packet->dts = ts;
+    packet->duration = 0;
+    av_packet_rescale_ts(packet, usec_time_base, stream->time_base);
+
+    int ret = av_interleaved_write_frame(ctx, packet);
+    if (ret < 0) {
+        elog("iso recorder: write error %d, stopping", ret);
+        close();
+        failed = true;
+        return;
+    }
+
+    bytes_written += p->size;
+}
+
+void IsoRecorder::close(void) {
+    if (ctx) {
+        if (packet)
+            av_write_trailer(ctx);
+
+        if (ctx->pb && !(ctx->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&ctx->pb);
+
+        avformat_free_context(ctx);
+        ctx = NULL;
+    }
+
+    if (packet)
+        av_packet_free(&packet);
+
+    video_stream = NULL;
+    audio_stream = NULL;
+}
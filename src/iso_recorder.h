@@ -0,0 +1,139 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <vector>
+#include <mutex>
+#include <util/threading.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#define ISO_BUFFER_MAX (64 * 1024 * 1024)
+#define ISO_CONFIG_MAX 1024
+
+// Between the last packet of a stream and the first of the next one,
+// when a recording carries on across a reconnect
+#define ISO_JOIN_GAP_US 40000
+
+struct IsoPacket {
+    uint8_t *data;
+    size_t size;
+    uint64_t pts; // usec, phone clock
+    bool video;
+    bool keyframe;
+};
+
+// Records the received video (H.264 or MJPEG) and AAC packets to a file
+// as-is, without transcoding.
+// The receive threads only copy packets into a bounded queue. Opening
+// the file, muxing and all disk I/O happen on the recorder thread. When
+// the queue is full, packets are dropped and video resumes at the next
+// keyframe.
+//
+// The video size is parsed from each stream's H.264 SPS or first MJPEG
+// frame, falling back to the requested size, so nothing depends on frames
+// being decoded. Packets are held until it is known. A reconnect at the same size
+// and codec config carries on in the same file, with the new stream's
+// timestamps moved on from the last packet; otherwise, and on a codec
+// config change mid-stream, the recording continues in a new file.
+struct IsoRecorder {
+    pthread_t thread;
+    os_event_t *signal;
+    volatile bool running;
+
+    std::mutex lock;
+    std::vector<IsoPacket> queue;
+    size_t queued_bytes;
+    bool video_gap;
+    bool joining;       // waiting for the new stream's first packet
+    int64_t pts_offset; // added to the current stream's timestamps
+    uint64_t last_pts;
+
+    // stream setup, guarded by lock
+    bool has_video;
+    bool has_audio;
+    enum AVCodecID video_codec;
+    int width;
+    int height;
+    int req_width;      // requested size, if the stream's can't be parsed
+    int req_height;
+    bool sizing;        // holding packets until the stream's size is known
+    bool split;         // continue in next_path
+    size_t split_at;    // from this queued packet on
+    char next_path[512];
+    uint8_t video_config[ISO_CONFIG_MAX];
+    size_t video_config_size;
+    uint8_t audio_config[ISO_CONFIG_MAX];
+    size_t audio_config_size;
+    int sample_rate;
+    int channels;
+
+    // recorder thread only
+    char path[512];
+    AVFormatContext *ctx;
+    AVStream *video_stream;
+    AVStream *audio_stream;
+    AVPacket *packet;
+    uint64_t pts_base;
+    uint64_t first_key_pts;
+    int64_t last_ts[2];
+    bool failed;
+
+    // stats
+    uint64_t bytes_written;
+    uint64_t dropped;
+
+    IsoRecorder(void) {
+        signal = NULL;
+        running = false;
+        queued_bytes = 0;
+        joining = false;
+        pts_offset = 0;
+        last_pts = 0;
+        req_width = 0;
+        req_height = 0;
+        sizing = false;
+        split = false;
+        split_at = 0;
+        next_path[0] = 0;
+        video_config_size = 0;
+        audio_config_size = 0;
+        sample_rate = 0;
+        channels = 0;
+        ctx = NULL;
+        packet = NULL;
+        path[0] = 0;
+        bytes_written = 0;
+        dropped = 0;
+    }
+
+    ~IsoRecorder(void) {
+        stop();
+        if (signal) os_event_destroy(signal);
+    }
+
+    // Start a new file. `video_codec` is AV_CODEC_ID_NONE for audio only.
+    // `w`x`h` is the requested size.
+    bool start(const char *file, enum AVCodecID codec, int w, int h, bool audio);
+    // A new stream after a reconnect: carry on in the current file, or
+    // in `file` if the size or codec config turn out to differ
+    void resume(const char *file, int w, int h);
+    // Set up for a new file without the recorder thread, to mux() directly
+    void reset(const char *file, enum AVCodecID codec, int w, int h, bool audio);
+    void stop(void);
+
+    // Codec config as received: H.264 SPS/PPS (Annex B), AAC AudioSpecificConfig
+    void set_video_config(const uint8_t *data, size_t size);
+    void set_audio_config(const uint8_t *data, size_t size, int rate, int nb_channels);
+
+    // Called from the receive threads, never blocks on I/O
+    void write(const uint8_t *data, size_t size, uint64_t pts, bool video, bool keyframe);
+
+    // The stream's size is known, with the lock held
+    void set_video_size(int w, int h);
+
+    // recorder thread
+    bool open(IsoPacket *p);
+    void mux(IsoPacket *p);
+    void close(void);
+};
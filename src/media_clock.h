@@ -0,0 +1,185 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#ifndef __MEDIA_CLOCK_H__
+#define __MEDIA_CLOCK_H__
+
+#include <stdint.h>
+#include <math.h>
+#include <mutex>
+
+#define MEDIA_CLOCK_MIN_LATENCY_MS 20
+#define MEDIA_CLOCK_MAX_LATENCY_MS 500
+
+// How fast the latency margin may follow the jitter, ns per ns of
+// stream time. Mapped timestamps then never stretch by more than 1%.
+#define MEDIA_CLOCK_SLEW 0.01
+
+// Maps phone pts (usec) onto the local (OBS) clock.
+//
+// Every received packet is an observation of the clock offset
+// (arrival - pts), which is the true offset plus a non-negative network
+// and scheduling delay. The loop tracks the delay floor: each window
+// yields the minimum observed offset, which feeds a second order loop
+// (phase + rate) so the phone/host oscillator drift is estimated without
+// being biased by the delay itself. Mapped timestamps include a latency
+// margin derived from the observed jitter above the floor, bounded by
+// MEDIA_CLOCK_MAX_LATENCY_MS, and slewed towards it at MEDIA_CLOCK_SLEW
+// so the per packet jitter estimate does not jitter the timestamps.
+#define MEDIA_CLOCK_WINDOW_US 1000000
+
+struct MediaClock {
+    std::mutex lock;
+    bool locked;
+    double offset;   // ns, local - phone at pts_ref
+    double drift;    // local ns per phone ns, minus one
+    double jitter;   // ns, smoothed delay above the floor
+    double min_latency; // ns, set by the owner (eg. audio buffer depth)
+    double margin;   // ns, added to mapped timestamps
+    uint64_t margin_pts;
+    uint64_t pts_ref;
+    uint64_t updates;
+    uint64_t resets;
+
+    // current floor window
+    double win_min;
+    uint64_t win_pts;
+    uint64_t win_start;
+    int windows;
+
+    MediaClock(void) {
+        resets = 0;
+        min_latency = 0;
+        reset();
+    }
+
+    void reset(void) {
+        lock.lock();
+        locked = false;
+        offset = 0;
+        drift = 0;
+        jitter = 0;
+        margin = 0;
+        margin_pts = 0;
+        pts_ref = 0;
+        updates = 0;
+        windows = 0;
+        lock.unlock();
+    }
+
+    inline double predict(uint64_t pts) {
+        return offset + drift * ((double) pts - (double) pts_ref) * 1000.0;
+    }
+
+    void update(uint64_t pts, uint64_t arrival_ns) {
+        const double obs = (double) arrival_ns - (double) pts * 1000.0;
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (!locked) {
+            SET_REF:
+            offset = obs;
+            pts_ref = pts;
+            win_min = obs;
+            win_pts = pts;
+            win_start = pts;
+            locked = true;
+            margin = latency();
+            margin_pts = pts;
+            return;
+        }
+
+        const double err = obs - predict(pts);
+
+        // stream restarted or the phone clock jumped
+        if (fabs(err) > 2e9 || pts + MEDIA_CLOCK_WINDOW_US < win_start) {
+            resets++;
+            drift = 0;
+            jitter = 0;
+            updates = 0;
+            windows = 0;
+            goto SET_REF;
+        }
+
+        jitter += ((err > 0 ? err : 0) - jitter) / 16.0;
+        updates++;
+        slew_margin(pts);
+
+        if (obs < win_min) {
+            win_min = obs;
+            win_pts = pts;
+        }
+
+        if (pts - win_start < MEDIA_CLOCK_WINDOW_US)
+            return;
+
+        // Close the window: phase and rate update from the floor sample
+        const double dt = ((double) win_pts - (double) pts_ref) * 1000.0;
+        const double phase_err = win_min - predict(win_pts);
+        const double kp = windows < 4 ? 0.5 : 0.2;
+        const double ki = windows < 4 ? 0.3 : 0.05;
+
+        if (dt > 1e8) {
+            drift += ki * phase_err / dt;
+            if (drift >  1e-3) drift =  1e-3;
+            if (drift < -1e-3) drift = -1e-3;
+        }
+
+        offset = predict(win_pts) + kp * phase_err;
+        pts_ref = win_pts;
+        windows++;
+
+        win_min = obs;
+        win_pts = pts;
+        win_start = pts;
+    }
+
+    // Move the margin towards latency(), by at most MEDIA_CLOCK_SLEW of
+    // the stream time since the last step. Audio and video packets both
+    // step it, out of pts order.
+    inline void slew_margin(uint64_t pts) {
+        if (pts <= margin_pts)
+            return;
+
+        const double step = ((double) pts - (double) margin_pts) * 1000.0 * MEDIA_CLOCK_SLEW;
+        const double target = latency();
+        if (target > margin + step)      margin += step;
+        else if (target < margin - step) margin -= step;
+        else                             margin = target;
+        margin_pts = pts;
+    }
+
+    // Wanted margin, ns
+    inline double latency(void) {
+        double l = jitter * 3.0;
+        if (l < min_latency) l = min_latency;
+        if (l < MEDIA_CLOCK_MIN_LATENCY_MS * 1e6) l = MEDIA_CLOCK_MIN_LATENCY_MS * 1e6;
+        if (l > MEDIA_CLOCK_MAX_LATENCY_MS * 1e6) l = MEDIA_CLOCK_MAX_LATENCY_MS * 1e6;
+        return l;
+    }
+
+    // Local time at which `pts` should be presented, 0 if not locked yet
+    uint64_t map(uint64_t pts) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!locked)
+            return 0;
+
+        const double ts = (double) pts * 1000.0 + predict(pts) + margin;
+        return ts > 0 ? (uint64_t) ts : 0;
+    }
+
+    // Earliest local time `pts` could have arrived: its capture time on
+    // the local clock, plus the network floor. 0 until the first floor
+    // window has closed.
+    uint64_t floor_time(uint64_t pts) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!locked || windows == 0)
+            return 0;
+
+        const double ts = (double) pts * 1000.0 + predict(pts);
+        return ts > 0 ? (uint64_t) ts : 0;
+    }
+
+    inline double drift_ppm(void) { return drift * 1e6; }
+    inline double jitter_ms(void) { return jitter / 1e6; }
+    inline double latency_ms(void) { return margin / 1e6; }
+};
+
+#endif
@@ -14,6 +14,12 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <string.h>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <util/platform.h>
+
 #include "plugin.h"
 #include "mjpeg_decode.h"
 
@@ -21,7 +27,47 @@ extern "C" {
     FILE __iob_func[3] = { *stdin,*stdout,*stderr };
 }
 
+#define TJ_FLAGS (TJFLAG_FASTDCT | TJFLAG_FASTUPSAMPLE)
+
+// Below this, splitting the frame costs more than it saves
+#define BAND_MIN_HEIGHT 480
+
+// Auto backend choices, so each resolution is only benchmarked once
+#define CHOICES_MAX 8
+
+// TurboJPEG has to take this much of the frame interval before the
+// latency of frame threading is worth its throughput
+#define TJ_BUSY_MAX 0.8
+
+static std::mutex choice_lock;
+static struct { int width; int height; int frame_ms; int backend; } choices[CHOICES_MAX];
+static int nb_choices = 0;
+
+static int cached_choice(int width, int height, int frame_ms) {
+    std::lock_guard<std::mutex> guard(choice_lock);
+    for (int i = 0; i < nb_choices && i < CHOICES_MAX; i++)
+        if (choices[i].width == width && choices[i].height == height
+            && choices[i].frame_ms == frame_ms)
+            return choices[i].backend;
+
+    return MJPEG_AUTO;
+}
+
+static void cache_choice(int width, int height, int frame_ms, int backend) {
+    std::lock_guard<std::mutex> guard(choice_lock);
+    const int i = nb_choices++ % CHOICES_MAX;
+    choices[i].width = width;
+    choices[i].height = height;
+    choices[i].frame_ms = frame_ms;
+    choices[i].backend = backend;
+}
+
 MJpegDecoder::~MJpegDecoder(void) {
+    stop_bands();
+
+    if (av)
+        delete av;
+
     if (frameBuf)
         bfree(frameBuf);
 
@@ -29,7 +75,8 @@ MJpegDecoder::~MJpegDecoder(void) {
         tjDestroy(tj);
 }
 
-bool MJpegDecoder::init(void) {
+// TurboJPEG is always set up, it also reads the stream header
+bool MJpegDecoder::init(int mjpeg_backend) {
     if (tj) {
         elog("tj != NULL on init");
         return false;
@@ -41,14 +88,68 @@ bool MJpegDecoder::init(void) {
         return false;
     }
 
+    backend = mjpeg_backend;
+    active = mjpeg_backend;
+    if (active == MJPEG_LIBAVCODEC && !init_av())
+        active = MJPEG_TURBOJPEG;
+
     ready = true;
     return true;
 }
 
+bool MJpegDecoder::init_av(void) {
+    int threads = os_get_logical_cores();
+    if (threads > MJPEG_AV_THREADS) threads = MJPEG_AV_THREADS;
+
+    av = new FFMpegDecoder();
+    av->frame_threads = threads;
+    if (av->init(NULL, AV_CODEC_ID_MJPEG, false) < 0) {
+        elog("mjpeg: could not open the libavcodec decoder, using turbojpeg");
+        delete av;
+        av = NULL;
+        return false;
+    }
+
+    inflight_next = 0;
+    ilog("mjpeg: libavcodec decoder with %d frame threads", threads);
+    return true;
+}
+
+const char *MJpegDecoder::backend_name(void) {
+    switch (active) {
+    case MJPEG_TURBOJPEG:
+        return "turbojpeg";
+    case MJPEG_LIBAVCODEC:
+        return "libavcodec";
+    default:
+        return "auto (pending)";
+    }
+}
+
+int MJpegDecoder::print_stats(char *buf, size_t size) {
+    return snprintf(buf, size, "mjpeg: backend=%s threads=%d turbojpeg=%.2fms libavcodec=%.2fms\n",
+        backend_name(), av ? av->frame_threads : 1, tj_ms, av_ms);
+}
+
+void MJpegDecoder::flush(void) {
+    if (av)
+        av->flush();
+}
+
+bool MJpegDecoder::reopen(const uint8_t *config, size_t size) {
+    (void) config;
+    (void) size;
+    if (av && active == MJPEG_LIBAVCODEC)
+        return av->reopen(NULL, 0);
+
+    return true;
+}
+
 void MJpegDecoder::push_ready_packet(DataPacket* packet) {
     if (decodeQueue.items.size() > 1) {
         dlog("discard frame");
         recieveQueue.add_item(packet);
+        dropped++;
     } else {
         decodeQueue.add_item(packet);
     }
@@ -56,6 +157,141 @@ void MJpegDecoder::push_ready_packet(DataPacket* packet) {
 
 bool MJpegDecoder::decode_video(struct obs_source_frame2* obs_frame, DataPacket* data_packet,
         bool *got_output)
+{
+    if (active == MJPEG_AUTO)
+        return decode_auto(obs_frame, data_packet, got_output);
+
+    if (active == MJPEG_LIBAVCODEC)
+        return decode_av(obs_frame, data_packet, got_output);
+
+    return decode_tj(obs_frame, data_packet, got_output);
+}
+
+// Benchmark on the live stream. The first frame gives the resolution, the
+// second one the frame interval. Then MJPEG_BENCH_RUNS frames go to
+// TurboJPEG after one to set up its bands, and as many to libavcodec
+// once its frame threads are busy.
+// Only the time each spends on the decode thread counts, so this
+// compares how well they keep up. Every frame is still output.
+bool MJpegDecoder::decode_auto(struct obs_source_frame2* obs_frame, DataPacket* data_packet,
+        bool *got_output)
+{
+    if (mSubsamp == 0) {
+        first_pts = data_packet->pts;
+        return decode_tj(obs_frame, data_packet, got_output);
+    }
+
+    if (bench_frames == 0) {
+        frame_ms = data_packet->pts > first_pts ? (data_packet->pts - first_pts) / 1e3 : 0;
+        if (frame_ms <= 1 || frame_ms > 200)
+            frame_ms = MJPEG_FRAME_MS;
+
+        active = cached_choice(obs_frame->width, obs_frame->height, (int) frame_ms);
+        if (active == MJPEG_LIBAVCODEC && !av && !init_av())
+            active = MJPEG_TURBOJPEG;
+
+        if (active != MJPEG_AUTO) {
+            ilog("mjpeg: using %s for %dx%d", backend_name(), obs_frame->width, obs_frame->height);
+            return decode_video(obs_frame, data_packet, got_output);
+        }
+    }
+
+    const int tj_end = MJPEG_BENCH_RUNS + 1;
+    uint64_t start = os_gettime_ns();
+    if (bench_frames < tj_end) {
+        if (!decode_tj(obs_frame, data_packet, got_output))
+            return false;
+
+        if (bench_frames++ > 0)
+            tj_ns += os_gettime_ns() - start;
+        return true;
+    }
+
+    if (!av && !init_av()) {
+        pick_backend(obs_frame);
+        return decode_tj(obs_frame, data_packet, got_output);
+    }
+
+    // libavcodec may hand back an earlier frame
+    const uint64_t pts = data_packet->pts;
+    const uint64_t recv_ns = data_packet->recv_ns;
+    bool ok = decode_av(obs_frame, data_packet, got_output);
+    if (ok) {
+        // the first frame_threads only fill the pipeline
+        if (++bench_frames > tj_end + av->frame_threads)
+            av_ns += os_gettime_ns() - start;
+
+        if (bench_frames < tj_end + av->frame_threads + MJPEG_BENCH_RUNS)
+            return true;
+    }
+    else {
+        av_ns = 0;
+    }
+
+    pick_backend(obs_frame);
+    if (active == MJPEG_LIBAVCODEC)
+        return true;
+
+    // The output points into libavcodec's frame: decode this one again
+    // into frameBuf before libavcodec goes. Frames still in its
+    // pipeline are dropped.
+    data_packet->pts = pts;
+    data_packet->recv_ns = recv_ns;
+    ok = decode_tj(obs_frame, data_packet, got_output);
+    delete av;
+    av = NULL;
+    return ok;
+}
+
+// libavcodec's frame threads add frames of latency, so it is only picked
+// when TurboJPEG falls behind the stream and libavcodec is clearly faster
+void MJpegDecoder::pick_backend(struct obs_source_frame2* obs_frame) {
+    const int width = (int) obs_frame->width;
+    const int height = (int) obs_frame->height;
+
+    tj_ms = tj_ns / 1e6 / MJPEG_BENCH_RUNS;
+    av_ms = av_ns ? av_ns / 1e6 / MJPEG_BENCH_RUNS : 0;
+
+    const bool tj_behind = tj_ms > frame_ms * TJ_BUSY_MAX;
+    active = (tj_behind && av_ns && av_ms < tj_ms * 0.8) ? MJPEG_LIBAVCODEC : MJPEG_TURBOJPEG;
+    ilog("mjpeg: %dx%d @ %.1fms turbojpeg=%.2fms libavcodec=%.2fms per frame (+%.0fms latency), using %s",
+        width, height, frame_ms, tj_ms, av_ms, av ? (av->frame_threads - 1) * frame_ms : 0,
+        backend_name());
+    cache_choice(width, height, (int) frame_ms, active);
+}
+
+bool MJpegDecoder::decode_av(struct obs_source_frame2* obs_frame, DataPacket* data_packet,
+        bool *got_output)
+{
+    // libavcodec may read past the end of the data
+    const size_t used = data_packet->used;
+    data_packet->resize(used + AV_INPUT_BUFFER_PADDING_SIZE);
+    memset(data_packet->data + used, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    const int slot = inflight_next++ % MJPEG_INFLIGHT;
+    inflight[slot].pts = data_packet->pts;
+    inflight[slot].recv_ns = data_packet->recv_ns;
+
+    if (!av->decode_video_data(obs_frame, data_packet->data, used, data_packet->pts, false, got_output))
+        return false;
+
+    // While the threads are busy the output is an earlier frame
+    const uint64_t pts = (uint64_t) av->frame->pts;
+    if (*got_output && av->frame->pts != AV_NOPTS_VALUE && pts != data_packet->pts) {
+        for (int i = 0; i < MJPEG_INFLIGHT; i++) {
+            if (inflight[i].pts == pts) {
+                data_packet->pts = pts;
+                data_packet->recv_ns = inflight[i].recv_ns;
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool MJpegDecoder::decode_tj(struct obs_source_frame2* obs_frame, DataPacket* data_packet,
+        bool *got_output)
 {
     *got_output = false;
     if (mSubsamp == 0) {
@@ -75,12 +311,20 @@ bool MJpegDecoder::decode_video(struct obs_source_frame2* obs_frame, DataPacket*
             return false;
         }
 
-        int ySize  = width * height;
-        int uvSize = ySize / 4;
-
-        size_t Yuv420Size = ySize * 3 / 2;
+        size_t Yuv420Size = width * height * 3 / 2;
         frameBuf = (uint8_t*) brealloc(frameBuf, Yuv420Size);
 
+        obs_frame->width = width;
+        obs_frame->height = height;
+        mSubsamp = subsamp;
+    }
+
+    // After libavcodec frames, or an output reset
+    if (obs_frame->data[0] != frameBuf || obs_frame->format != VIDEO_FORMAT_I420) {
+        const int width = (int) obs_frame->width;
+        int ySize  = width * (int) obs_frame->height;
+        int uvSize = ySize / 4;
+
         obs_frame->linesize[0] = width;
         obs_frame->linesize[1] = width>>1;
         obs_frame->linesize[2] = width>>1;
@@ -90,11 +334,7 @@ bool MJpegDecoder::decode_video(struct obs_source_frame2* obs_frame, DataPacket*
         obs_frame->data[1] = obs_frame->data[0] + ySize;
         obs_frame->data[2] = obs_frame->data[1] + uvSize;
         obs_frame->data[3] = NULL;
-
-        obs_frame->width = width;
-        obs_frame->height = height;
         obs_frame->format = VIDEO_FORMAT_I420;
-        mSubsamp = subsamp;
     }
 
     if (obs_frame->range != VIDEO_RANGE_FULL) {
@@ -104,11 +344,19 @@ bool MJpegDecoder::decode_video(struct obs_source_frame2* obs_frame, DataPacket*
         obs_frame->range = VIDEO_RANGE_FULL;
     }
 
+    if (obs_frame->height >= BAND_MIN_HEIGHT && parallel != 0
+        && decode_parallel(obs_frame, data_packet))
+    {
+        obs_frame->flip = false;
+        *got_output = true;
+        return true;
+    }
+
     if (tjDecompressToYUVPlanes(tj,
         data_packet->data, data_packet->used,
         obs_frame->data, obs_frame->width,
         (int*)obs_frame->linesize, obs_frame->height,
-        TJFLAG_FASTDCT | TJFLAG_FASTUPSAMPLE))
+        TJ_FLAGS))
     {
         elog("tjDecompressToYUV2 failure: %d\n", tjGetErrorCode(tj));
         return false;
@@ -118,3 +366,332 @@ bool MJpegDecoder::decode_video(struct obs_source_frame2* obs_frame, DataPacket*
     *got_output = true;
     return true;
 }
+
+// Find the restart intervals of a baseline JPEG.
+// Returns false for anything that has to be decoded as a whole.
+bool MJpegDecoder::parse_layout(const uint8_t *data, size_t size) {
+    size_t p = 2;
+    layout.header_size = 0;
+    layout.sof_height = 0;
+    layout.restart_interval = 0;
+    layout.segments.clear();
+
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+
+    while (layout.header_size == 0) {
+        if (p + 4 > size || data[p] != 0xFF)
+            return false;
+
+        uint8_t marker = data[p+1];
+        if (marker == 0xFF) {
+            p++;
+            continue;
+        }
+
+        size_t len = (data[p+2] << 8) | data[p+3];
+        if (len < 2 || p + 2 + len > size)
+            return false;
+
+        switch (marker) {
+        case 0xC0: // baseline
+        case 0xC1:
+            layout.sof_height = p + 5;
+            break;
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            return false;
+        case 0xDD:
+            if (len >= 4)
+                layout.restart_interval = (data[p+4] << 8) | data[p+5];
+            break;
+        case 0xDA:
+            layout.header_size = p + 2 + len;
+            break;
+        }
+        p += 2 + len;
+    }
+
+    if (layout.sof_height == 0 || layout.restart_interval == 0)
+        return false;
+
+    size_t start = layout.header_size;
+    p = start;
+    while (p + 1 < size) {
+        const uint8_t *ff = (const uint8_t*) memchr(data + p, 0xFF, size - p - 1);
+        if (!ff)
+            return false;
+
+        p = ff - data;
+        uint8_t marker = data[p+1];
+        if (marker == 0x00 || marker == 0xFF) {
+            p++;
+            continue;
+        }
+
+        if (marker >= 0xD0 && marker <= 0xD7) {
+            layout.segments.push_back({start, p});
+            start = p + 2;
+            p += 2;
+            continue;
+        }
+
+        if (marker == 0xD9) {
+            layout.segments.push_back({start, p});
+            return true;
+        }
+
+        // DNL, a second scan, ...
+        return false;
+    }
+
+    return false;
+}
+
+// Bands queued by any decoder, taken by whichever pool thread is free.
+// A decoder waits for its own bands before returning the frame, so none
+// is left in the queue once the decoder goes away.
+static struct {
+    std::mutex lock;
+    std::condition_variable work;  // bands queued, or shutdown
+    std::condition_variable done;  // a band finished
+    std::vector<MJpegBand*> queue;
+    pthread_t threads[MJPEG_BANDS_MAX];
+    int nb_threads;
+    bool running;
+} band_pool;
+
+static void *band_thread(void *data) {
+    (void) data;
+    std::unique_lock<std::mutex> guard(band_pool.lock);
+    while (1) {
+        band_pool.work.wait(guard, [] { return !band_pool.running || !band_pool.queue.empty(); });
+        if (!band_pool.running)
+            break;
+
+        MJpegBand *band = band_pool.queue.front();
+        band_pool.queue.erase(band_pool.queue.begin());
+        guard.unlock();
+
+        band->ok = band->decoder->decode_band(band);
+
+        guard.lock();
+        band->finished = true;
+        band_pool.done.notify_all();
+    }
+    return NULL;
+}
+
+// Returns the number of pool threads
+static int band_pool_start(void) {
+    std::lock_guard<std::mutex> guard(band_pool.lock);
+    if (band_pool.running)
+        return band_pool.nb_threads;
+
+    // the decoding thread takes a band too
+    int count = os_get_logical_cores() - 1;
+    if (count > MJPEG_BANDS_MAX - 1) count = MJPEG_BANDS_MAX - 1;
+    if (count < 1)
+        return 0;
+
+    band_pool.running = true;
+    for (band_pool.nb_threads = 0; band_pool.nb_threads < count; band_pool.nb_threads++) {
+        if (pthread_create(&band_pool.threads[band_pool.nb_threads], NULL, band_thread, NULL) != 0) {
+            elog("mjpeg: error creating band worker");
+            break;
+        }
+    }
+
+    if (band_pool.nb_threads == 0)
+        band_pool.running = false;
+    else
+        ilog("mjpeg: %d band workers", band_pool.nb_threads);
+
+    return band_pool.nb_threads;
+}
+
+void mjpeg_band_pool_shutdown(void) {
+    band_pool.lock.lock();
+    const bool was_running = band_pool.running;
+    band_pool.running = false;
+    band_pool.lock.unlock();
+
+    if (!was_running)
+        return;
+
+    band_pool.work.notify_all();
+    for (int i = 0; i < band_pool.nb_threads; i++)
+        pthread_join(band_pool.threads[i], NULL);
+    band_pool.nb_threads = 0;
+}
+
+// One TurboJPEG handle per band this decoder can run at once
+bool MJpegDecoder::start_bands(void) {
+    int count = band_pool_start() + 1;
+    if (count > MJPEG_BANDS_MAX) count = MJPEG_BANDS_MAX;
+    if (count < 2)
+        return false;
+
+    memset(bands, 0, sizeof(bands));
+    for (nb_bands = 0; nb_bands < count; nb_bands++) {
+        MJpegBand *band = &bands[nb_bands];
+        band->decoder = this;
+        band->tj = tjInitDecompress();
+        if (!band->tj)
+            break;
+    }
+
+    dlog("mjpeg: %d band decoders", nb_bands);
+    return nb_bands > 1;
+}
+
+void MJpegDecoder::stop_bands(void) {
+    for (int i = 0; i < nb_bands; i++) {
+        MJpegBand *band = &bands[i];
+        if (band->tj) tjDestroy(band->tj);
+        if (band->buf) bfree(band->buf);
+    }
+    nb_bands = 0;
+}
+
+// Queue bands 1.. to the pool and decode band 0 here. Bands no pool
+// thread has taken yet, with the pool busy on other sources, are taken
+// back and decoded here too.
+void MJpegDecoder::run_bands(int count) {
+    std::unique_lock<std::mutex> guard(band_pool.lock);
+    for (int i = 1; i < count; i++) {
+        bands[i].finished = false;
+        band_pool.queue.push_back(&bands[i]);
+    }
+    guard.unlock();
+    band_pool.work.notify_all();
+
+    bands[0].ok = decode_band(&bands[0]);
+
+    guard.lock();
+    for (int i = 1; i < count; i++) {
+        auto it = std::find(band_pool.queue.begin(), band_pool.queue.end(), &bands[i]);
+        if (it == band_pool.queue.end())
+            continue;
+
+        band_pool.queue.erase(it);
+        guard.unlock();
+        bands[i].ok = decode_band(&bands[i]);
+        guard.lock();
+        bands[i].finished = true;
+    }
+
+    band_pool.done.wait(guard, [this, count] {
+        for (int i = 1; i < count; i++)
+            if (!bands[i].finished) return false;
+        return true;
+    });
+}
+
+// Rebuild the band as a JPEG of its own: the original headers with the
+// band height, then its restart intervals renumbered from RST0.
+bool MJpegDecoder::decode_band(MJpegBand *band) {
+    const uint8_t *data = band_data;
+    struct obs_source_frame2 *frame = band_frame;
+    size_t need = layout.header_size + 2;
+
+    for (size_t i = band->first; i < band->last; i++)
+        need += layout.segments[i].end - layout.segments[i].start + 2;
+
+    if (band->buf_size < need) {
+        band->buf = (uint8_t*) brealloc(band->buf, need);
+        band->buf_size = need;
+    }
+
+    uint8_t *p = band->buf;
+    memcpy(p, data, layout.header_size);
+    p[layout.sof_height] = (uint8_t) (band->height >> 8);
+    p[layout.sof_height + 1] = (uint8_t) band->height;
+    p += layout.header_size;
+
+    for (size_t i = band->first; i < band->last; i++) {
+        const MJpegSegment *seg = &layout.segments[i];
+        if (i > band->first) {
+            *p++ = 0xFF;
+            *p++ = (uint8_t) (0xD0 + ((i - band->first - 1) & 7));
+        }
+        memcpy(p, data + seg->start, seg->end - seg->start);
+        p += seg->end - seg->start;
+    }
+    *p++ = 0xFF;
+    *p++ = 0xD9;
+
+    // 4:2:0, bands start on a 16 line MCU row
+    uint8_t *planes[3] = {
+        frame->data[0] + (size_t) band->y * frame->linesize[0],
+        frame->data[1] + (size_t) (band->y / 2) * frame->linesize[1],
+        frame->data[2] + (size_t) (band->y / 2) * frame->linesize[2],
+    };
+
+    if (tjDecompressToYUVPlanes(band->tj, band->buf, (unsigned long) (p - band->buf),
+        planes, frame->width, (int*)frame->linesize, band->height, TJ_FLAGS))
+    {
+        elog("band decode failure: %s", tjGetErrorStr2(band->tj));
+        return false;
+    }
+
+    return true;
+}
+
+bool MJpegDecoder::decode_parallel(struct obs_source_frame2* obs_frame, DataPacket* data_packet) {
+    const int width = (int) obs_frame->width;
+    const int height = (int) obs_frame->height;
+    const int mcu_cols = (width + 15) / 16;
+    const int mcu_rows = (height + 15) / 16;
+
+    if (!parse_layout(data_packet->data, data_packet->used)
+        || layout.restart_interval % mcu_cols != 0)
+    {
+        if (parallel != 0)
+            ilog("mjpeg: no usable restart intervals, decoding whole frames");
+        parallel = 0;
+        return false;
+    }
+
+    const int rows_per_segment = layout.restart_interval / mcu_cols;
+    const size_t segments = (mcu_rows + rows_per_segment - 1) / rows_per_segment;
+    if (layout.segments.size() != segments)
+        return false;
+
+    if (nb_bands == 0 && !start_bands()) {
+        stop_bands();
+        parallel = 0;
+        return false;
+    }
+
+    int count = nb_bands;
+    if ((size_t) count > segments) count = (int) segments;
+    if (count < 2)
+        return false;
+
+    if (parallel != count)
+        ilog("mjpeg: restart interval %d, decoding in %d bands", layout.restart_interval, count);
+    parallel = count;
+
+    band_data = data_packet->data;
+    band_frame = obs_frame;
+
+    for (int i = 0; i < count; i++) {
+        MJpegBand *band = &bands[i];
+        band->first = segments * i / count;
+        band->last = segments * (i + 1) / count;
+
+        int y_end = (int) band->last * rows_per_segment * 16;
+        band->y = (int) band->first * rows_per_segment * 16;
+        band->height = (y_end < height ? y_end : height) - band->y;
+        band->ok = false;
+    }
+
+    run_bands(count);
+
+    bool ok = true;
+    for (int i = 0; i < count; i++)
+        ok = ok && bands[i].ok;
+
+    return ok;
+}
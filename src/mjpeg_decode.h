@@ -4,31 +4,145 @@
 
 extern "C" {
 #include <obs.h>
+#include <util/threading.h>
 #include "turbojpeg.h"
 }
 
 #include "decoder.h"
+#include "ffmpeg_decode.h"
 
+#define MJPEG_BANDS_MAX 8
+#define MJPEG_AV_THREADS 4
+#define MJPEG_BENCH_RUNS 8
+#define MJPEG_INFLIGHT 16
+#define MJPEG_FRAME_MS 33.3 // until the stream's frame interval is seen
+
+// The band decode threads are shared by all MJPEG decoders in the
+// process, started with the first one that can use them.
+// Module unload (or process exit), after all decoders are gone.
+void mjpeg_band_pool_shutdown(void);
+
+enum MJpegBackend {
+    MJPEG_AUTO,
+    MJPEG_TURBOJPEG,
+    MJPEG_LIBAVCODEC,
+};
+
+// One entropy coded segment, between restart markers
+struct MJpegSegment {
+    size_t start;
+    size_t end;
+};
+
+// Where the pieces of a baseline JPEG with restart intervals are
+struct MJpegLayout {
+    size_t header_size; // SOI up to and including SOS
+    size_t sof_height;  // offset of the height field in SOF
+    int restart_interval;
+    std::vector<MJpegSegment> segments;
+};
+
+struct MJpegDecoder;
+
+// A horizontal band of the frame, rebuilt as a standalone JPEG from a
+// run of restart intervals and decoded straight into the frame planes,
+// by the decoding thread or the shared band pool.
+struct MJpegBand {
+    MJpegDecoder *decoder;
+    tjhandle tj;
+    uint8_t *buf;
+    size_t buf_size;
+    size_t first;  // segments [first, last)
+    size_t last;
+    int y;
+    int height;
+    bool ok;
+    bool finished; // guarded by the band pool lock
+};
+
+// Frames go to TurboJPEG (with restart marker bands) or to libavcodec's
+// mjpeg decoder with frame threading, which has more throughput on some
+// machines but holds MJPEG_AV_THREADS-1 frames in flight. Auto decodes
+// the first incoming frames with TurboJPEG and then with libavcodec, and
+// only takes libavcodec when TurboJPEG cannot keep up with the frame
+// rate, remembered per resolution and frame interval.
 struct MJpegDecoder : Decoder {
     tjhandle tj;
     uint8_t *frameBuf;
     int mSubsamp;
 
+    int backend;  // MJpegBackend, as configured
+    int active;   // MJpegBackend in use, MJPEG_AUTO until benchmarked
+    FFMpegDecoder *av;
+    double tj_ms; // benchmark, per frame
+    double av_ms;
+    int bench_frames;
+    uint64_t tj_ns;
+    uint64_t av_ns;
+    uint64_t first_pts;
+    double frame_ms; // stream frame interval, from the first two frames
+
+    // pts -> receive time, for the frames in the libavcodec pipeline
+    struct { uint64_t pts; uint64_t recv_ns; } inflight[MJPEG_INFLIGHT];
+    int inflight_next;
+
+    // Restart marker parallel decode. Band 0 runs on the decode thread,
+    // the others are queued to the band pool.
+    MJpegBand bands[MJPEG_BANDS_MAX];
+    int nb_bands;
+    MJpegLayout layout;
+    const uint8_t *band_data;
+    struct obs_source_frame2 *band_frame;
+    int parallel; // -1 unknown, 0 whole-frame, else band count in use
+
     MJpegDecoder(void) {
         tj = NULL;
         frameBuf = NULL;
         mSubsamp = 0;
+        backend = MJPEG_TURBOJPEG;
+        active = MJPEG_TURBOJPEG;
+        av = NULL;
+        tj_ms = 0;
+        av_ms = 0;
+        bench_frames = 0;
+        tj_ns = 0;
+        av_ns = 0;
+        first_pts = 0;
+        frame_ms = 0;
+        inflight_next = 0;
+        nb_bands = 0;
+        band_data = NULL;
+        band_frame = NULL;
+        parallel = -1;
     }
 
     ~MJpegDecoder(void);
-    bool init(void);
+    bool init(int mjpeg_backend);
     bool decode_video(struct obs_source_frame2*, DataPacket*, bool *got_output);
+    bool decode_tj(struct obs_source_frame2*, DataPacket*, bool *got_output);
+    bool decode_av(struct obs_source_frame2*, DataPacket*, bool *got_output);
+    bool init_av(void);
+    bool decode_auto(struct obs_source_frame2*, DataPacket*, bool *got_output);
+    void pick_backend(struct obs_source_frame2*);
+    void flush(void);
+    bool reopen(const uint8_t*, size_t);
+    const char *backend_name(void);
+    int print_stats(char *buf, size_t size);
+
+    bool parse_layout(const uint8_t *data, size_t size);
+    bool start_bands(void);
+    void stop_bands(void);
+    bool decode_band(MJpegBand *band);
+    void run_bands(int count);
+    bool decode_parallel(struct obs_source_frame2*, DataPacket*);
     bool decode_audio(struct obs_source_audio* a, DataPacket* d, bool *got_output) {
         (void) a; (void) d;
         *got_output = false;
         return false;
     }
 
+    // every frame is independent
+    bool is_reference(DataPacket*) { return false; }
     void push_ready_packet(DataPacket*);
 };
 
@@ -32,6 +32,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 # include <netdb.h>
 # include <fcntl.h>
 # include <unistd.h>
+# include <sys/ioctl.h>
 #endif
 
 bool set_nonblock(socket_t sock, int nonblock) {
@@ -292,6 +293,21 @@ net_recv_peek(socket_t sock) {
     return recv(sock, buf, 1, MSG_PEEK);
 }
 
+// Bytes received and not yet read, -1 on error
+ssize_t
+net_recv_pending(socket_t sock) {
+#if _WIN32
+    u_long pending = 0;
+    if (ioctlsocket(sock, FIONREAD, &pending) != NO_ERROR)
+        return -1;
+#else
+    int pending = 0;
+    if (ioctl(sock, FIONREAD, &pending) < 0)
+        return -1;
+#endif
+    return (ssize_t) pending;
+}
+
 ssize_t
 net_recv_all(socket_t sock, void *buf, size_t len) {
 #if _WIN32
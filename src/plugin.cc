@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #include <libavcodec/avcodec.h>
 }
+#include <util/config-file.h>
 
 #if DROIDCAM_OVERRIDE
 #define ENABLE_GUI 1
@@ -41,9 +42,14 @@ AddDevice* addDevUI = NULL;
 
 #include "plugin.h"
 #include "source.h"
+#include "decode_scheduler.h"
+#include "mjpeg_decode.h"
+#include "replay_buffer.h"
+#include "thread_tuning.h"
 #include "plugin_properties.h"
 
 const char* bindIP = NULL;
+struct ThreadTuning thread_defaults;
 char os_name_version[64];
 struct obs_source_info droidcam_obs_info;
 
@@ -92,6 +98,35 @@ static inline void swap_bindIP() {
 }
 #endif
 
+// Global thread defaults, [Threads] Sched, Nice and Affinity in the
+// module's config.ini. Sources use them unless set otherwise.
+static void load_thread_defaults(void) {
+    config_t *config;
+    char *path = obs_module_config_path("config.ini");
+    if (!path)
+        return;
+
+    if (config_open(&config, path, CONFIG_OPEN_EXISTING) == CONFIG_SUCCESS) {
+        config_set_default_int(config, "Threads", "Sched", THREAD_SCHED_DEFAULT);
+        config_set_default_int(config, "Threads", "Nice", 0);
+        config_set_default_string(config, "Threads", "Affinity", "");
+
+        thread_defaults.sched = (int) config_get_int(config, "Threads", "Sched");
+        if (thread_defaults.sched < THREAD_SCHED_DEFAULT || thread_defaults.sched > THREAD_SCHED_FIFO)
+            thread_defaults.sched = THREAD_SCHED_DEFAULT;
+
+        thread_defaults.nice = (int) config_get_int(config, "Threads", "Nice");
+        snprintf(thread_defaults.affinity, sizeof(thread_defaults.affinity), "%s",
+            config_get_string(config, "Threads", "Affinity"));
+        config_close(config);
+
+        ilog("thread defaults: sched=%d nice=%d cpus=%s",
+            thread_defaults.sched, thread_defaults.nice, thread_defaults.affinity);
+    }
+
+    bfree(path);
+}
+
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("droidcam-obs", "en-US")
 MODULE_EXPORT const char *obs_module_description(void) {
@@ -157,8 +192,12 @@ bool obs_module_load(void) {
     #endif
 
     get_os_name_version(os_name_version, sizeof(os_name_version));
+    load_thread_defaults();
     return true;
 }
 
 void obs_module_unload(void) {
+    decode_scheduler_shutdown();
+    mjpeg_band_pool_shutdown();
+    replay_save_shutdown();
 }
@@ -3,15 +3,41 @@
 #define OPT_VERSION           "version"
 #define OPT_WIFI_IP           "wifi_ip"
 #define OPT_APP_PORT          "app_port"
+#define OPT_SUBNET_SCAN       "subnet_scan"
 #define OPT_RESOLUTION        "resolution"
 #define OPT_VIDEO_FORMAT      "video_format"
+#define OPT_TALLY_RESOLUTION  "tally_resolution"
+#define OPT_IDLE_RESOLUTION   "idle_resolution"
+#define OPT_ADAPTIVE_QUALITY  "adaptive_quality"
+#define OPT_QUALITY_MIN       "quality_min"
+#define OPT_QUALITY_MAX       "quality_max"
 #define OPT_CONNECT           "connect"
 #define OPT_REFRESH           "refresh"
 #define OPT_DEACTIVATE_WNS    "deactivate_wns"
+#define OPT_STANDBY_MODE      "standby_mode"
 #define OPT_SYNC_AV           "sync_av"
 #define OPT_USE_HW_ACCEL      "allow_hw_accel"
+#define OPT_MJPEG_BACKEND     "mjpeg_backend"
+#define OPT_MATCH_CANVAS_FPS  "match_canvas_fps"
+#define OPT_PIPELINE_MODE     "pipeline_mode"
+#define OPT_URING_RECV        "uring_recv"
+#define OPT_DECODE_WORKER     "decode_worker"
+#define OPT_BACKPRESSURE      "backpressure_ms"
+#define OPT_HOLD_FRAME        "hold_frame_ms"
+#define OPT_SYNC_GROUP        "sync_group"
+#define OPT_THREAD_SCHED      "thread_sched"
+#define OPT_THREAD_NICE       "thread_nice"
+#define OPT_THREAD_AFFINITY   "thread_affinity"
+#define OPT_ISO_RECORD        "iso_record"
+#define OPT_ISO_PATH          "iso_path"
+#define OPT_ISO_FORMAT        "iso_format"
+#define OPT_REPLAY_SECONDS    "replay_seconds"
+#define OPT_REPLAY_MB         "replay_mb"
+#define OPT_REPLAY_SAVE       "replay_save"
 #define OPT_IS_ACTIVATED      "activated"
 #define OPT_ENABLE_AUDIO      "enable_aduio"
+#define OPT_AUDIO_BUFFER      "audio_buffer_ms"
+#define OPT_AUDIO_ONLY        "audio_only"
 #define OPT_DEVICE_LIST       "device_list"
 #define OPT_DEVICE_ID_WIFI    "dev_id_wifi"
 #define OPT_ACTIVE_DEV_ID     "cur_dev_id"
@@ -22,15 +48,57 @@
 
 #define TEXT_DEVICE         obs_module_text("Device")
 #define TEXT_REFRESH        obs_module_text("Refresh")
+#define TEXT_SUBNET_SCAN    obs_module_text("SubnetScan")
 #define TEXT_RESOLUTION     obs_module_text("Resolution")
 #define TEXT_VIDEO_FORMAT   obs_module_text("VideoFormat")
+#define TEXT_TALLY_RESOLUTION obs_module_text("TallyResolution")
+#define TEXT_IDLE_RESOLUTION  obs_module_text("IdleResolution")
+#define TEXT_ADAPTIVE_QUALITY obs_module_text("AdaptiveQuality")
+#define TEXT_QUALITY_MIN    obs_module_text("AdaptiveQuality.Min")
+#define TEXT_QUALITY_MAX    obs_module_text("AdaptiveQuality.Max")
 #define TEXT_CONNECT        obs_module_text("Activate")
 #define TEXT_DEACTIVATE     obs_module_text("Deactivate")
 #define TEXT_DWNS           obs_module_text("DeactivateWhenNotShowing")
+#define TEXT_STANDBY_MODE   obs_module_text("StandbyMode")
+#define TEXT_STANDBY_OFF    obs_module_text("StandbyMode.Off")
+#define TEXT_STANDBY_KEYFRAMES obs_module_text("StandbyMode.Keyframes")
+#define TEXT_STANDBY_NO_DECODE obs_module_text("StandbyMode.NoDecode")
 #define TEXT_USE_WIFI       obs_module_text("UseWiFi")
 #define TEXT_ENABLE_AUDIO   obs_module_text("EnableAudio")
+#define TEXT_AUDIO_BUFFER   obs_module_text("AudioBuffer")
+#define TEXT_AUDIO_ONLY     obs_module_text("AudioOnly")
 #define TEXT_SYNC_AV        obs_module_text("SyncAV")
 #define TEXT_USE_HW_ACCEL   obs_module_text("AllowHWAccel")
+#define TEXT_MJPEG_BACKEND  obs_module_text("MJPEGBackend")
+#define TEXT_MJPEG_AUTO     obs_module_text("MJPEGBackend.Auto")
+#define TEXT_MJPEG_TURBOJPEG obs_module_text("MJPEGBackend.TurboJPEG")
+#define TEXT_MJPEG_LIBAVCODEC obs_module_text("MJPEGBackend.Libavcodec")
+#define TEXT_MATCH_CANVAS_FPS obs_module_text("MatchCanvasFPS")
+#define TEXT_PIPELINE_MODE  obs_module_text("PipelineMode")
+#define TEXT_PIPELINE_QUEUED obs_module_text("PipelineMode.Queued")
+#define TEXT_PIPELINE_INLINE obs_module_text("PipelineMode.Inline")
+#define TEXT_PIPELINE_CHUNKED obs_module_text("PipelineMode.Chunked")
+#define TEXT_URING_RECV     obs_module_text("UringRecv")
+#define TEXT_DECODE_WORKER  obs_module_text("DecodeWorker")
+#define TEXT_BACKPRESSURE   obs_module_text("Backpressure")
+#define TEXT_HOLD_FRAME     obs_module_text("HoldFrame")
+#define TEXT_SYNC_GROUP     obs_module_text("SyncGroup")
+#define TEXT_SYNC_GROUP_NONE obs_module_text("SyncGroup.None")
+#define TEXT_SYNC_GROUP_N   obs_module_text("SyncGroup.N")
+#define TEXT_THREAD_SCHED   obs_module_text("ThreadSched")
+#define TEXT_THREAD_SCHED_GLOBAL  obs_module_text("ThreadSched.Global")
+#define TEXT_THREAD_SCHED_DEFAULT obs_module_text("ThreadSched.Default")
+#define TEXT_THREAD_SCHED_NICE    obs_module_text("ThreadSched.Nice")
+#define TEXT_THREAD_SCHED_RR      obs_module_text("ThreadSched.RR")
+#define TEXT_THREAD_SCHED_FIFO    obs_module_text("ThreadSched.FIFO")
+#define TEXT_THREAD_NICE    obs_module_text("ThreadNice")
+#define TEXT_THREAD_AFFINITY obs_module_text("ThreadAffinity")
+#define TEXT_ISO_RECORD     obs_module_text("IsoRecord")
+#define TEXT_ISO_PATH       obs_module_text("IsoRecord.Path")
+#define TEXT_ISO_FORMAT     obs_module_text("IsoRecord.Format")
+#define TEXT_REPLAY_SECONDS obs_module_text("Replay.Seconds")
+#define TEXT_REPLAY_MB      obs_module_text("Replay.Memory")
+#define TEXT_REPLAY_SAVE    obs_module_text("Replay.Save")
 
 #define PING_REQ "GET /ping"
 #define BATT_REQ "GET /battery HTTP/1.1\r\n\r\n"
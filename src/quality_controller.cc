@@ -0,0 +1,178 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "plugin.h"
+#include "quality_controller.h"
+
+#define NANO_SEC 1000000000ULL
+#define WINDOW_NS (2 * NANO_SEC)
+
+// Bad windows in a row before stepping down
+#define DOWN_WINDOWS 2
+
+// Good windows in a row before stepping up, and how long after a step
+// down before trying again
+#define UP_WINDOWS 5
+#define UP_HOLDOFF_NS (30 * NANO_SEC)
+
+// Decode time as a fraction of the frame interval
+#define LOAD_HIGH 0.85
+#define LOAD_LOW  0.50
+
+// Transit delay above the floor, in frame intervals. Past this, frames
+// are queueing up somewhere on the link.
+#define TRANSIT_HIGH 3.0
+#define TRANSIT_LOW  1.0
+
+void QualityController::reset(int new_floor, int new_cap, int new_level) {
+    std::lock_guard<std::mutex> guard(lock);
+    floor = new_floor;
+    cap = (new_cap < new_floor) ? new_floor : new_cap;
+    level = new_level;
+    if (level > cap) level = cap;
+    if (level < floor) level = floor;
+
+    win_start = 0;
+    warmup = true;
+    frames = 0;
+    bytes = 0;
+    decoded = 0;
+    decode_ns = 0;
+    queue_ns = 0;
+    transit_ns = 0;
+    transits = 0;
+    drops_base = 0;
+    bad = 0;
+    good = 0;
+    fps = 0;
+    mbps = 0;
+    decode_ms = 0;
+    queue_ms = 0;
+    transit_ms = 0;
+    load = 0;
+    drops = 0;
+}
+
+void QualityController::restart(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    win_start = 0;
+    warmup = true;
+    frames = 0;
+    bytes = 0;
+    decoded = 0;
+    decode_ns = 0;
+    queue_ns = 0;
+    transit_ns = 0;
+    transits = 0;
+}
+
+void QualityController::on_packet(size_t size, uint64_t transit_time_ns) {
+    std::lock_guard<std::mutex> guard(lock);
+    frames++;
+    bytes += size;
+    if (transit_time_ns) {
+        transit_ns += transit_time_ns;
+        transits++;
+    }
+}
+
+void QualityController::on_decode(uint64_t decode_time_ns, uint64_t queue_time_ns) {
+    std::lock_guard<std::mutex> guard(lock);
+    decoded++;
+    decode_ns += decode_time_ns;
+    queue_ns += queue_time_ns;
+}
+
+void QualityController::close_window(uint64_t now, uint64_t total_drops) {
+    const double duration = (double) (now - win_start);
+    const double interval = duration / (double) frames;
+
+    fps = (double) frames * NANO_SEC / duration;
+    mbps = (double) bytes * 8000.0 / duration;
+    decode_ms = decoded ? (double) decode_ns / (double) decoded / 1e6 : 0;
+    queue_ms = decoded ? (double) queue_ns / (double) decoded / 1e6 : 0;
+    transit_ms = transits ? (double) transit_ns / (double) transits / 1e6 : 0;
+    load = decode_ms * 1e6 / interval;
+    drops = total_drops - drops_base;
+
+    // Frames arriving later and later behind the floor mean the link
+    // can no longer carry the stream
+    const bool overload = load > LOAD_HIGH
+        || queue_ms * 1e6 > interval * 2
+        || drops * 20 > frames
+        || transit_ms * 1e6 > interval * TRANSIT_HIGH;
+
+    const bool headroom = load < LOAD_LOW
+        && queue_ms * 1e6 < interval
+        && drops == 0
+        && transit_ms * 1e6 < interval * TRANSIT_LOW;
+
+    if (overload) {
+        good = 0;
+        if (++bad >= DOWN_WINDOWS && level > floor) {
+            level--;
+            bad = 0;
+            last_down_ns = now;
+            downgrades++;
+            ilog("quality: step down, load=%.2f queue=%.1fms transit=%.1fms drops=%llu fps=%.1f",
+                load, queue_ms, transit_ms, (unsigned long long) drops, fps);
+        }
+    }
+    else if (headroom) {
+        bad = 0;
+        if (++good >= UP_WINDOWS && level < cap
+            && (last_down_ns == 0 || (now - last_down_ns) > UP_HOLDOFF_NS))
+        {
+            level++;
+            good = 0;
+            upgrades++;
+            ilog("quality: step up, load=%.2f queue=%.1fms fps=%.1f", load, queue_ms, fps);
+        }
+    }
+    else {
+        bad = 0;
+        good = 0;
+    }
+}
+
+int QualityController::evaluate(uint64_t now, uint64_t total_drops) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (win_start == 0) {
+        win_start = now;
+        drops_base = total_drops;
+        return level;
+    }
+
+    if ((now - win_start) < WINDOW_NS)
+        return level;
+
+    // The first window after a (re)connect includes decoder startup
+    if (!warmup && frames > 0)
+        close_window(now, total_drops);
+
+    warmup = false;
+    win_start = now;
+    frames = 0;
+    bytes = 0;
+    decoded = 0;
+    decode_ns = 0;
+    queue_ns = 0;
+    transit_ns = 0;
+    transits = 0;
+    drops_base = total_drops;
+    return level;
+}
@@ -0,0 +1,73 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+
+// Closed-loop stream resolution control.
+//
+// Watches decode time per frame, queue delay (receive to decode start),
+// dropped frames and the network transit delay (arrival past the media
+// clock's delay floor) over fixed windows. The received frame rate is
+// only reported: the phone lowers it on its own, eg. in low light.
+// Consecutive bad windows step the level (an index into Resolutions[])
+// down by one; a sustained run of windows with clear headroom steps it
+// back up, but never soon after a step down. The caller applies a new
+// level by reconnecting.
+struct QualityController {
+    std::mutex lock;
+    int floor;
+    int cap;
+    int level;
+
+    // current window
+    uint64_t win_start;
+    bool warmup;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t decoded;
+    uint64_t decode_ns;
+    uint64_t queue_ns;
+    uint64_t transit_ns;
+    uint64_t transits;
+    uint64_t drops_base;
+    int bad;
+    int good;
+    uint64_t last_down_ns;
+
+    // last closed window, for stats
+    double fps;
+    double mbps;
+    double decode_ms;
+    double queue_ms;
+    double transit_ms;
+    double load;
+    uint64_t drops;
+    uint64_t downgrades;
+    uint64_t upgrades;
+
+    QualityController(void) {
+        floor = 0;
+        cap = 0;
+        level = 0;
+        last_down_ns = 0;
+        downgrades = 0;
+        upgrades = 0;
+        reset(0, 0, 0);
+    }
+
+    // Start over on a new connection, keeping the level within limits
+    void reset(int new_floor, int new_cap, int new_level);
+
+    // Drop the current measurement window, eg. after a pause
+    void restart(void);
+
+    // `transit_time_ns` is 0 until the media clock has a floor
+    void on_packet(size_t size, uint64_t transit_time_ns);
+    void on_decode(uint64_t decode_time_ns, uint64_t queue_time_ns);
+
+    // Close the window when due and return the level the stream should be at.
+    // `total_drops` is the running count of frames dropped under pressure.
+    int evaluate(uint64_t now, uint64_t total_drops);
+    void close_window(uint64_t now, uint64_t total_drops);
+};
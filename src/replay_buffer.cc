@@ -0,0 +1,281 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <obs.h>
+
+#include "plugin.h"
+#include "replay_buffer.h"
+
+// A save thread, joined once done by the next save, or when its
+// buffer goes away or the module unloads
+struct ReplaySave {
+    pthread_t thread;
+    const ReplayBuffer *owner;
+    volatile bool done;
+};
+
+static std::mutex saves_lock;
+static std::vector<ReplaySave*> saves_running;
+
+struct ReplayJob {
+    IsoRecorder recorder;
+    std::vector<IsoPacket> packets;
+    ReplaySave *save;
+};
+
+// owner NULL matches every buffer
+static void join_saves(const ReplayBuffer *owner, bool done_only) {
+    std::vector<ReplaySave*> joining;
+
+    saves_lock.lock();
+    for (size_t i = 0; i < saves_running.size();) {
+        ReplaySave *save = saves_running[i];
+        if ((owner && save->owner != owner) || (done_only && !save->done)) {
+            i++;
+            continue;
+        }
+
+        joining.push_back(save);
+        saves_running.erase(saves_running.begin() + i);
+    }
+    saves_lock.unlock();
+
+    for (size_t i = 0; i < joining.size(); i++) {
+        pthread_join(joining[i]->thread, NULL);
+        delete joining[i];
+    }
+}
+
+static void *replay_save_thread(void *data) {
+    ReplayJob *job = (ReplayJob*)(data);
+    IsoRecorder *r = &job->recorder;
+
+    for (size_t i = 0; i < job->packets.size(); i++) {
+        if (!r->failed)
+            r->mux(&job->packets[i]);
+
+        bfree(job->packets[i].data);
+    }
+
+    r->close();
+    if (r->failed || r->bytes_written == 0)
+        elog("replay: could not save %s", r->path);
+    else
+        ilog("replay: saved %.1fMB to %s", r->bytes_written / 1048576.0, r->path);
+
+    ReplaySave *save = job->save;
+    delete job;
+    save->done = true;
+    return NULL;
+}
+
+void ReplayBuffer::configure(int seconds, int megabytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    max_us = (uint64_t) seconds * 1000000ULL;
+    max_bytes = (size_t) megabytes * 1024 * 1024;
+
+    if (max_us == 0) {
+        while (packets.size())
+            drop_front();
+        return;
+    }
+
+    trim();
+}
+
+void ReplayBuffer::clear(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    while (packets.size())
+        drop_front();
+}
+
+void ReplayBuffer::start(enum AVCodecID codec, int w, int h) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (packets.size() && codec == video_codec && w == width && h == height) {
+        ilog("replay: joining the new stream to %.1fs buffered",
+            (last_video_pts - packets.front().pts) / 1e6);
+        joining = true;
+        return;
+    }
+
+    while (packets.size())
+        drop_front();
+
+    video_codec = codec;
+    width = w;
+    height = h;
+    video_config_size = 0;
+    last_video_pts = 0;
+    last_pts = 0;
+    pts_offset = 0;
+    joining = false;
+}
+
+void ReplayBuffer::set_video_config(const uint8_t *data, size_t size) {
+    if (size > sizeof(video_config))
+        return;
+
+    // The file has a single config, older packets may not decode with
+    // a new one
+    std::lock_guard<std::mutex> guard(lock);
+    if (packets.size() && video_config_size
+        && (size != video_config_size || memcmp(video_config, data, size) != 0))
+    {
+        ilog("replay: codec config changed, starting over");
+        while (packets.size())
+            drop_front();
+    }
+
+    memcpy(video_config, data, size);
+    video_config_size = size;
+}
+
+void ReplayBuffer::set_audio_config(const uint8_t *data, size_t size, int rate, int nb_channels) {
+    if (size > sizeof(audio_config))
+        return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    memcpy(audio_config, data, size);
+    audio_config_size = size;
+    sample_rate = rate;
+    channels = nb_channels;
+}
+
+// Drop the oldest packet, and everything up to the next video keyframe
+void ReplayBuffer::drop_front(void) {
+    do {
+        IsoPacket *p = &packets.front();
+        bytes -= p->size;
+        bfree(p->data);
+        packets.pop_front();
+    } while (packets.size() && !(packets.front().video && packets.front().keyframe));
+}
+
+void ReplayBuffer::trim(void) {
+    while (packets.size()) {
+        const uint64_t pts = packets.front().pts;
+        if (bytes <= max_bytes && (last_video_pts <= pts || last_video_pts - pts <= max_us))
+            break;
+
+        drop_front();
+    }
+}
+
+void ReplayBuffer::write(const uint8_t *data, size_t size, uint64_t pts, bool video, bool keyframe) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (max_us == 0 || video_codec == AV_CODEC_ID_NONE)
+        return;
+
+    if ((packets.empty() || joining) && !(video && keyframe))
+        return;
+
+    if (packets.empty()) {
+        pts_offset = 0;
+        last_pts = 0;
+        joining = false;
+    }
+    else if (joining) {
+        pts_offset = (int64_t) (last_pts + REPLAY_JOIN_GAP_US) - (int64_t) pts;
+        joining = false;
+    }
+
+    pts = (uint64_t) ((int64_t) pts + pts_offset);
+
+    IsoPacket p;
+    p.data = (uint8_t*) bmalloc(size);
+    memcpy(p.data, data, size);
+    p.size = size;
+    p.pts = pts;
+    p.video = video;
+    p.keyframe = keyframe;
+
+    packets.push_back(p);
+    bytes += size;
+    if (video)
+        last_video_pts = pts;
+    if (pts > last_pts)
+        last_pts = pts;
+
+    trim();
+}
+
+bool ReplayBuffer::save(const char *file) {
+    join_saves(NULL, true);
+
+    ReplayJob *job = new ReplayJob();
+    ReplaySave *save = new ReplaySave();
+    save->owner = this;
+    save->done = false;
+    job->save = save;
+
+    lock.lock();
+    if (packets.empty() || (video_codec == AV_CODEC_ID_H264 && video_config_size == 0)) {
+        lock.unlock();
+        elog("replay: nothing to save");
+        delete save;
+        delete job;
+        return false;
+    }
+
+    job->recorder.reset(file, video_codec, width, height, audio_config_size > 0);
+    job->recorder.set_video_config(video_config, video_config_size);
+    if (audio_config_size)
+        job->recorder.set_audio_config(audio_config, audio_config_size, sample_rate, channels);
+
+    job->packets.reserve(packets.size());
+    for (size_t i = 0; i < packets.size(); i++) {
+        IsoPacket p = packets[i];
+        p.data = (uint8_t*) bmalloc(p.size);
+        memcpy(p.data, packets[i].data, p.size);
+        job->packets.push_back(p);
+    }
+    saves++;
+    lock.unlock();
+
+    // registered first, so a wait never misses it
+    saves_lock.lock();
+    if (pthread_create(&save->thread, NULL, replay_save_thread, job) != 0) {
+        saves_lock.unlock();
+        elog("replay: error creating thread");
+        for (size_t i = 0; i < job->packets.size(); i++)
+            bfree(job->packets[i].data);
+
+        delete save;
+        delete job;
+        return false;
+    }
+
+    saves_running.push_back(save);
+    saves_lock.unlock();
+    return true;
+}
+
+void ReplayBuffer::wait_saves(void) {
+    join_saves(this, false);
+}
+
+void replay_save_shutdown(void) {
+    join_saves(NULL, false);
+}
+
+double ReplayBuffer::duration(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (packets.empty() || last_video_pts < packets.front().pts)
+        return 0;
+
+    return (last_video_pts - packets.front().pts) / 1e6;
+}
@@ -0,0 +1,101 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <deque>
+#include <mutex>
+
+#include "iso_recorder.h"
+
+// Between the last packet of a stream and the first of the next one,
+// when the buffer carries on across a reconnect
+#define REPLAY_JOIN_GAP_US 40000
+
+// Instant replay: the last N seconds of the compressed stream, as
+// received, kept in memory until asked to save it.
+//
+// The oldest packets are dropped a whole GOP at a time, so the buffer
+// always starts on a video keyframe, and stays within both `max_us` of
+// video and `max_bytes`. The codec config is kept separately so the
+// saved file can be decoded from its first packet. Saving copies the
+// buffer and muxes it to a file on a separate thread, with no decoding
+// or encoding.
+//
+// A reconnect or quality switch that keeps the codec, size and codec
+// config carries on in the same buffer: the new stream is joined at its
+// first keyframe, with its timestamps moved on from the last packet.
+struct ReplayBuffer {
+    std::mutex lock;
+    std::deque<IsoPacket> packets;
+    size_t bytes;
+    size_t max_bytes;
+    uint64_t max_us;
+    uint64_t last_video_pts;
+    uint64_t last_pts;
+    int64_t pts_offset;  // added to the current stream's timestamps
+    bool joining;        // waiting for the new stream's first keyframe
+
+    enum AVCodecID video_codec;
+    int width;
+    int height;
+    uint8_t video_config[ISO_CONFIG_MAX];
+    size_t video_config_size;
+    uint8_t audio_config[ISO_CONFIG_MAX];
+    size_t audio_config_size;
+    int sample_rate;
+    int channels;
+
+    // stats
+    uint64_t saves;
+
+    ReplayBuffer(void) {
+        bytes = 0;
+        max_bytes = 0;
+        max_us = 0;
+        last_video_pts = 0;
+        last_pts = 0;
+        pts_offset = 0;
+        joining = false;
+        video_codec = AV_CODEC_ID_NONE;
+        width = 0;
+        height = 0;
+        video_config_size = 0;
+        audio_config_size = 0;
+        sample_rate = 0;
+        channels = 0;
+        saves = 0;
+    }
+
+    ~ReplayBuffer(void) {
+        wait_saves();
+        clear();
+    }
+
+    bool enabled(void) { return max_us > 0; }
+
+    // 0 seconds turns the buffer off
+    void configure(int seconds, int megabytes);
+
+    // A new video stream. What is buffered is kept when it matches.
+    void start(enum AVCodecID codec, int w, int h);
+    void clear(void);
+
+    void set_video_config(const uint8_t *data, size_t size);
+    void set_audio_config(const uint8_t *data, size_t size, int rate, int nb_channels);
+
+    void write(const uint8_t *data, size_t size, uint64_t pts, bool video, bool keyframe);
+
+    // Write the buffer out to `file`, returns once the copy is taken
+    bool save(const char *file);
+
+    // Wait for this buffer's saves still being written
+    void wait_saves(void);
+
+    // Buffered video duration, seconds
+    double duration(void);
+
+    // with lock held
+    void trim(void);
+    void drop_front(void);
+};
+
+// Module unload: wait for every save still being written
+void replay_save_shutdown(void);
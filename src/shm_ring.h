@@ -0,0 +1,127 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <obs.h>
+
+#if __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <util/platform.h>
+#endif
+
+#define SHM_RING_MAGIC 0x44434652 // "DCFR"
+#define SHM_RING_SLOTS 4
+#define SHM_SLOT_SIZE (3840 * 2160 * 2) // 4K 4:2:2, the largest decoder output
+#define SHM_PAGE 4096
+
+// A decoded frame in shared memory. The data pointers in `frame` belong
+// to the worker's address space, the planes are found by `offset`.
+struct ShmSlot {
+    struct obs_source_frame2 frame;
+    uint32_t offset[MAX_AV_PLANES];
+    uint64_t pts;
+    uint64_t recv_ns;
+};
+
+// Frame ring shared by the decode worker (the only writer) and the
+// plugin (the only reader), with preallocated slots after the header.
+//
+// Counters only ever increase and are read and written with atomics, so
+// neither side takes a lock. The worker fills slot write_seq and then
+// publishes it by incrementing write_seq; the plugin releases slots by
+// advancing read_seq. An empty ring is waited on with a futex on
+// write_seq, and the worker only makes the wake syscall while the
+// reader is marked waiting. A full ring drops the new frame.
+struct ShmRing {
+    uint32_t magic;
+    uint32_t slot_size;
+    uint32_t write_seq;
+    uint32_t read_seq;
+    uint32_t reader_waiting;
+    uint32_t reserved;
+
+    // written by the worker
+    uint64_t decoded;
+    uint64_t dropped;
+    uint64_t decode_ns; // smoothed
+
+    ShmSlot slots[SHM_RING_SLOTS];
+};
+
+static inline size_t shm_ring_header_size(void) {
+    return (sizeof(ShmRing) + SHM_PAGE - 1) / SHM_PAGE * SHM_PAGE;
+}
+
+static inline size_t shm_ring_size(void) {
+    return shm_ring_header_size() + (size_t) SHM_RING_SLOTS * SHM_SLOT_SIZE;
+}
+
+static inline uint8_t *shm_slot_data(ShmRing *ring, uint32_t seq) {
+    return (uint8_t*) ring + shm_ring_header_size() + (size_t) (seq % SHM_RING_SLOTS) * SHM_SLOT_SIZE;
+}
+
+static inline void shm_ring_reset(ShmRing *ring) {
+    memset(ring, 0, sizeof(ShmRing));
+    ring->magic = SHM_RING_MAGIC;
+    ring->slot_size = SHM_SLOT_SIZE;
+}
+
+#if __linux__
+// Not FUTEX_PRIVATE: the word is shared between processes
+static inline void shm_futex_wait(uint32_t *addr, uint32_t val, int timeout_ms) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static inline void shm_futex_wake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+#else
+static inline void shm_futex_wait(uint32_t *addr, uint32_t val, int timeout_ms) {
+    (void) addr; (void) val; (void) timeout_ms;
+    os_sleep_ms(1);
+}
+
+static inline void shm_futex_wake(uint32_t *addr) {
+    (void) addr;
+}
+#endif
+
+// Worker: the slot to fill next, NULL when the ring is full
+static inline ShmSlot *shm_ring_acquire(ShmRing *ring) {
+    const uint32_t w = ring->write_seq;
+    if (w - __atomic_load_n(&ring->read_seq, __ATOMIC_ACQUIRE) >= SHM_RING_SLOTS)
+        return NULL;
+
+    return &ring->slots[w % SHM_RING_SLOTS];
+}
+
+static inline void shm_ring_publish(ShmRing *ring) {
+    __atomic_store_n(&ring->write_seq, ring->write_seq + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->reader_waiting, __ATOMIC_SEQ_CST))
+        shm_futex_wake(&ring->write_seq);
+}
+
+// Plugin: wait up to timeout_ms for frame `seq` to be published
+static inline bool shm_ring_wait(ShmRing *ring, uint32_t seq, int timeout_ms) {
+    if (__atomic_load_n(&ring->write_seq, __ATOMIC_ACQUIRE) != seq)
+        return true;
+
+    __atomic_store_n(&ring->reader_waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->write_seq, __ATOMIC_SEQ_CST) == seq)
+        shm_futex_wait(&ring->write_seq, seq, timeout_ms);
+    __atomic_store_n(&ring->reader_waiting, 0, __ATOMIC_RELAXED);
+
+    return __atomic_load_n(&ring->write_seq, __ATOMIC_ACQUIRE) != seq;
+}
+
+// Plugin: slots before `seq` may be reused
+static inline void shm_ring_release(ShmRing *ring, uint32_t seq) {
+    __atomic_store_n(&ring->read_seq, seq, __ATOMIC_RELEASE);
+}
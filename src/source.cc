@@ -34,6 +34,18 @@ extern QMainWindow *main_window;
 #include "plugin_properties.h"
 #include "ffmpeg_decode.h"
 #include "mjpeg_decode.h"
+#include "audio_buffer.h"
+#include "frame_decimator.h"
+#include "quality_controller.h"
+#include "iso_recorder.h"
+#include "replay_buffer.h"
+#include "frame_hold.h"
+#include "decode_scheduler.h"
+#include "thread_tuning.h"
+#include "uring_recv.h"
+#include "sync_group.h"
+#include "video_stream.h"
+#include "decode_worker.h"
 #include "net.h"
 #include "buffer_util.h"
 #include "device_discovery.h"
@@ -53,31 +65,108 @@ struct droidcam_obs_source {
     AdbMgr adbMgr;
     USBMux iosMgr;
     MDNS mdnsMgr;
+    SubnetScan scanMgr;
     Decoder* video_decoder;
     Decoder* audio_decoder;
     obs_source_t *source;
     os_event_t *stop_signal;
     os_event_t *reset_signal;
     os_event_t *comms_signal;
+    os_event_t *drain_signal; // a queued packet was decoded
     pthread_t audio_thread;
+    pthread_t audio_decode_thread;
     pthread_t video_thread;
-    pthread_t video_decode_thread;
     pthread_t comms_thread;
     enum video_range_type range;
     bool is_showing;
+    bool visible;   // shown anywhere, unlike is_showing kept regardless of deactivateWNS
+    bool standby;
+    bool wait_keyframe;
     bool activated;
     bool deactivateWNS;
     bool enable_audio;
+    bool audio_only;
+    bool video_threads;
+    bool decode_thread;
+    bool inline_decode;
+    bool chunked_decode;
+    bool uring_recv;
+    bool decode_worker;
+    bool worker_stream;  // the current stream is decoded by `worker`
+    bool worker_restart;
     bool use_hw;
+    int mjpeg_backend;
     bool audio_running;
     bool video_running;
+    bool sync_av;
+    bool subnet_scan;
+    bool match_canvas_fps;
+    bool iso_record;
+    bool video_blank;
+    int hold_ms;
+    uint64_t hold_until;
+    int backpressure_ms;
+    bool throttled;
+    uint64_t throttled_ns;
+    uint64_t throttle_events;
     int video_resolution;
+    int stream_resolution;
+    int idle_resolution;
+    bool tally_resolution;
+    bool adaptive_quality;
+    bool quality_reset;
+    int quality_min;
+    int quality_max;
+    int quality_cap;
+    int quality_level;
+    uint64_t tally_idle_since;
     int usb_port;
     enum VideoFormat video_format;
+    enum StandbyMode standby_mode;
+    enum PipelineMode pipeline_mode;
+    uint64_t video_latency_ns;
+    uint64_t backlog_skips;
+    size_t avg_packet_size;
+    uint64_t standby_last_ns;
+    uint64_t standby_skipped;
+    uint64_t stream_switches;
+    uint64_t switch_fallbacks;
+    uint8_t video_config[ISO_CONFIG_MAX];
+    int video_config_len;
+    std::mutex video_config_lock; // video_config is also read by the decode workers
+    char decoder_stats[256];      // the decoder's stats line, copied by whoever decodes
+    uint64_t decoder_stats_ns;
+    std::mutex decoder_stats_lock;
+    uint64_t config_changes;
+    bool decode_recovering;
+    bool decode_gave_up;
+    int decode_errors;
+    uint64_t decode_error_ns;
+    uint64_t decode_recoveries;
+    uint64_t video_frames;
     struct active_device_info device_info;
     struct obs_source_audio obs_audio_frame;
     struct obs_source_frame2 obs_video_frame;
     uint64_t time_start;
+    AudioJitterBuffer audio_buffer;
+    MediaClock media_clock;
+    FrameDecimator decimator;
+    QualityController quality;
+    IsoRecorder iso;
+    ReplayBuffer replay;
+    obs_hotkey_id replay_hotkey;
+    FrameHold hold;
+    SyncMember sync;
+    SyncOutput sync_output;
+    UringRecv uring;
+    DecodeWorker worker;
+    DecodeClient decode_client;
+    struct ThreadTuning thread_tuning;
+    volatile long tuning_gen;
+    struct ThreadState video_thread_state;
+    struct ThreadState audio_thread_state;
+    struct ThreadState audio_decode_state;
+    std::mutex audio_decoder_lock;
     #if DROIDCAM_OVERRIDE
     std::vector<OBSSignal> signal_handlers;
     #endif
@@ -101,7 +190,9 @@ static void signal_source_update(obs_source_t* source, const char* battery_level
     os_event_signal(plugin->comms_signal);\
     } while(0)
 
-static socket_t connect(struct droidcam_obs_source *plugin) {
+// `control` is set for the video connection, which also sets up the
+// web control link.
+static socket_t connect(struct droidcam_obs_source *plugin, bool control = false) {
     Device* dev;
     AdbMgr* adbMgr = &plugin->adbMgr;
     USBMux* iosMgr = &plugin->iosMgr;
@@ -134,6 +225,18 @@ static socket_t connect(struct droidcam_obs_source *plugin) {
             }
 
             int port_start = device_info->port + ((adbMgr->Iter()-1) * 10);
+            socket_t sock = adbMgr->Connect(dev, device_info->port);
+            if (sock != INVALID_SOCKET) {
+                // the web control link still needs a forward, made once
+                if (control && plugin->usb_port == 0
+                    && adbMgr->AddForward(dev, port_start, device_info->port))
+                {
+                    plugin->usb_port = port_start;
+                }
+                return sock;
+            }
+
+            dlog("ADB: no direct transport, using forward");
             if (plugin->usb_port < port_start) {
                 plugin->usb_port = port_start;
             }
@@ -162,7 +265,7 @@ static socket_t connect(struct droidcam_obs_source *plugin) {
     if (device_info->type == DeviceType::IOS) {
         dev = iosMgr->GetDevice(device_info->id);
         if (dev) {
-            return iosMgr->Connect(dev, device_info->port, &plugin->usb_port);
+            return iosMgr->Connect(dev, device_info->port, control ? &plugin->usb_port : NULL);
         }
 
         iosMgr->Reload();
@@ -173,122 +276,466 @@ static socket_t connect(struct droidcam_obs_source *plugin) {
     return INVALID_SOCKET;
 }
 
-#define MAXCONFIG 1024
-#define MAXPACKET 1024 * 1024
-static DataPacket*
-read_frame(Decoder *decoder, socket_t sock, int *has_config)
+// A file in the recording folder named after the source, `tag` (optional)
+// and the time
+static bool output_path(droidcam_obs_source *plugin, const char *tag, const char *ext,
+    char *path, size_t size)
 {
-    uint8_t header[HEADER_SIZE];
-    uint8_t config[MAXCONFIG];
-    size_t r;
-    size_t len, config_len = 0;
-    uint64_t pts;
-
-    AGAIN:
-    r = net_recv_all(sock, header, HEADER_SIZE);
-    if (r != HEADER_SIZE) {
-        elog("read header recv returned %ld", r);
-        return NULL;
+    char name[128];
+    bool ok = false;
+
+    obs_data_t *settings = obs_source_get_settings(plugin->source);
+    const char *dir = obs_data_get_string(settings, OPT_ISO_PATH);
+    if (!dir || dir[0] == 0) {
+        elog("recording folder not set");
+        goto out;
     }
 
-    pts = buffer_read64be(header);
-    len = buffer_read32be(&header[8]);
-    // dlog("read_frame: header: pts=%llu len=%ld", pts, len);
+    snprintf(name, sizeof(name), "%s", obs_source_get_name(plugin->source));
+    for (char *c = name; *c; c++) {
+        if (strchr("/\\:*?\"<>|", *c)) *c = '_';
+    }
 
-    if (pts == NO_PTS) {
-        if (config_len != 0) {
-             elog("double config ???");
-             return NULL;
-        }
+    {
+        char *file = os_generate_formatted_filename(ext, true, "%CCYY-%MM-%DD %hh-%mm-%ss");
+        if (tag)
+            snprintf(path, size, "%s/%s %s %s", dir, name, tag, file);
+        else
+            snprintf(path, size, "%s/%s %s", dir, name, file);
+        bfree(file);
+    }
 
-        if ((int)len == -1) {
-            elog("stop/error from app side");
-            return NULL;
-        }
+    os_mkdirs(dir);
+    ok = true;
 
-        if (len == 0 || len > MAXCONFIG) {
-            elog("config packet too large at %ld!", len);
-            return NULL;
-        }
+out:
+    obs_data_release(settings);
+    return ok;
+}
+
+static enum AVCodecID video_codec_id(droidcam_obs_source *plugin, int *width, int *height) {
+    sscanf(Resolutions[plugin->stream_resolution], "%dx%d", width, height);
+    return (plugin->video_format == FORMAT_AVC) ? AV_CODEC_ID_H264 : AV_CODEC_ID_MJPEG;
+}
+
+// Start an ISO recording, named after the source and the time. A
+// recording of the same kind carries on across reconnects; the recorder
+// only moves to the new file if the stream turns out different.
+static void iso_start(droidcam_obs_source *plugin, bool video) {
+    char path[512];
+    int width = 0, height = 0;
+    enum AVCodecID codec = AV_CODEC_ID_NONE;
+
+    obs_data_t *settings = obs_source_get_settings(plugin->source);
+    const char *ext = obs_data_get_string(settings, OPT_ISO_FORMAT);
+    if (output_path(plugin, NULL, ext, path, sizeof(path))) {
+        if (video)
+            codec = video_codec_id(plugin, &width, &height);
+
+        if (plugin->iso.running && plugin->iso.video_codec == codec)
+            plugin->iso.resume(path, width, height);
+        else
+            plugin->iso.start(path, codec, width, height,
+                plugin->enable_audio || plugin->audio_only);
+    }
+    obs_data_release(settings);
+}
+
+// The recording ends with the stream, but not on a reconnect
+static bool iso_continues(droidcam_obs_source *plugin) {
+    return plugin->iso_record && plugin->activated && plugin->is_showing;
+}
+
+// The replay buffer follows the video stream, from its first keyframe
+static void replay_start(droidcam_obs_source *plugin) {
+    int width = 0, height = 0;
+    enum AVCodecID codec = video_codec_id(plugin, &width, &height);
+    plugin->replay.start(codec, width, height);
+}
+
+static bool replay_save(droidcam_obs_source *plugin) {
+    char path[512];
+    if (!plugin->replay.enabled() || !output_path(plugin, "Replay", "mp4", path, sizeof(path)))
+        return false;
+
+    ilog("replay: saving %.1fs to %s", plugin->replay.duration(), path);
+    return plugin->replay.save(path);
+}
+
+// Hold the frame back to the sync group's latency.
+// Returns false when it should be output right away.
+static bool sync_video_frame(droidcam_obs_source *plugin, uint64_t pts) {
+    const uint64_t capture = plugin->media_clock.floor_time(pts);
+    if (!capture)
+        return false;
 
-        r = net_recv_all(sock, config, len);
-        if (r != len) {
-            elog("read config recv returned %ld", r);
-            return NULL;
+    const uint64_t now = os_gettime_ns();
+    const uint64_t due = sync_group_schedule(&plugin->sync, capture, now);
+    plugin->obs_video_frame.timestamp = due;
+
+    // once frames are queued, later ones must not overtake them
+    if (due < now + 1000000ULL && !plugin->sync_output.running)
+        return false;
+
+    if (!plugin->sync_output.start(plugin->source))
+        return false;
+
+    plugin->sync_output.push(&plugin->obs_video_frame, due);
+    return true;
+}
+
+static void output_video_frame(droidcam_obs_source *plugin, uint64_t pts, uint64_t recv_ns) {
+    uint64_t ts = plugin->media_clock.map(pts);
+    plugin->obs_video_frame.timestamp = ts ? ts : pts * 1000;
+    //if (flip) plugin->obs_video_frame.flip = !plugin->obs_video_frame.flip;
+    #if 0
+    dlog("output video: %dx%d %lu",
+        plugin->obs_video_frame.width,
+        plugin->obs_video_frame.height,
+        plugin->obs_video_frame.timestamp);
+    #endif
+    if (!(plugin->sync.group > 0 && sync_video_frame(plugin, pts)))
+        obs_source_output_video2(plugin->source, &plugin->obs_video_frame);
+    plugin->video_blank = false;
+
+    // receive -> output latency, smoothed
+    uint64_t latency = os_gettime_ns() - recv_ns;
+    plugin->video_latency_ns = plugin->video_latency_ns
+        ? (plugin->video_latency_ns * 15 + latency) / 16
+        : latency;
+}
+
+// Decode errors drop the stream to the next keyframe, which starts on a
+// fresh codec. Only when errors keep coming back is the decoder marked
+// failed, and the video thread reconnects.
+
+static void decode_error(droidcam_obs_source *plugin, Decoder *decoder) {
+    const uint64_t now = os_gettime_ns();
+    if (plugin->decode_errors == 0 || (now - plugin->decode_error_ns) > DECODE_RETRY_WINDOW_NS) {
+        plugin->decode_errors = 0;
+        plugin->decode_error_ns = now;
+    }
+
+    if (++plugin->decode_errors > DECODE_RETRY_BUDGET) {
+        elog("too many video decode errors, giving up on the stream");
+        plugin->decode_gave_up = true;
+        decoder->failed = true;
+        return;
+    }
+
+    elog("error decoding video, waiting for a keyframe (%d/%d)",
+        plugin->decode_errors, DECODE_RETRY_BUDGET);
+    plugin->decode_recovering = true;
+}
+
+// The output format and color parameters are re-derived from the next
+// decoded frame
+static void reset_video_output(droidcam_obs_source *plugin) {
+    plugin->obs_video_frame.format = VIDEO_FORMAT_NONE;
+    plugin->obs_video_frame.range  = VIDEO_RANGE_DEFAULT;
+}
+
+static void decode_video_packet(droidcam_obs_source *plugin, Decoder *decoder, DataPacket* data_packet) {
+    uint8_t config[ISO_CONFIG_MAX];
+    int config_len;
+    bool got_output;
+
+    if (plugin->decode_recovering) {
+        if (!decoder->is_keyframe(data_packet))
+            return;
+
+        // The video thread may be storing a new config meanwhile
+        plugin->video_config_lock.lock();
+        config_len = plugin->video_config_len;
+        memcpy(config, plugin->video_config, config_len);
+        plugin->video_config_lock.unlock();
+
+        reset_video_output(plugin);
+        if (!decoder->reopen(config, config_len)) {
+            plugin->decode_gave_up = true;
+            decoder->failed = true;
+            return;
         }
 
-        ilog("have config: %ld", len);
-        config_len = len;
-        *has_config = 1;
-        goto AGAIN;
+        plugin->decode_recovering = false;
+        plugin->decode_recoveries++;
+    }
+    else if (data_packet->new_config) {
+        // New SPS/PPS: the codec picks them up in-band, but frames
+        // decoded with the old ones can go
+        decoder->flush();
+        reset_video_output(plugin);
     }
 
-    if (len == 0 || len > MAXPACKET) {
-        elog("data packet too large at %ld!", len);
-        return NULL;
+    const uint64_t start = os_gettime_ns();
+    if (!decoder->decode_video(&plugin->obs_video_frame, data_packet, &got_output)) {
+        decode_error(plugin, decoder);
+        return;
     }
 
-    DataPacket* data_packet = decoder->pull_empty_packet(config_len + len);
-    uint8_t *p = data_packet->data;
-    if (config_len) {
-        memcpy(p, config, config_len);
-        p += config_len;
+    if (plugin->adaptive_quality)
+        plugin->quality.on_decode(os_gettime_ns() - start, start - data_packet->recv_ns);
+
+    // The stats are read on another thread, which must not touch a
+    // decoder that can be swapped or freed under it
+    if (start - plugin->decoder_stats_ns > NANO_SEC / 2) {
+        std::lock_guard<std::mutex> guard(plugin->decoder_stats_lock);
+        plugin->decoder_stats[0] = 0;
+        decoder->print_stats(plugin->decoder_stats, sizeof(plugin->decoder_stats));
+        plugin->decoder_stats_ns = start;
     }
 
-    r = net_recv_all(sock, p, len);
-    if (r != len) {
-        elog("read_frame: read %ld bytes wanted %ld", r, len);
-        decoder->push_empty_packet(data_packet);
-        return NULL;
+    if (got_output)
+        output_video_frame(plugin, data_packet->pts, data_packet->recv_ns);
+}
+
+static void decode_video_chunk(ChunkFeed *feed, uint8_t *data, size_t size) {
+    droidcam_obs_source *plugin = feed->plugin;
+    FFMpegDecoder *decoder = (FFMpegDecoder*) feed->decoder;
+    bool got_output;
+
+    if (feed->failed || size == 0)
+        return;
+
+    const uint64_t start = os_gettime_ns();
+    if (!decoder->decode_video_data(&plugin->obs_video_frame, data, size, feed->pts, false, &got_output)) {
+        feed->failed = true;
+        decode_error(plugin, decoder);
+        return;
     }
 
-    data_packet->pts = pts;
-    data_packet->used = config_len + len;
-    return data_packet;
+    feed->decode_ns += os_gettime_ns() - start;
+    if (got_output)
+        output_video_frame(plugin, feed->pts, feed->recv_ns);
 }
 
-static void *video_decode_thread(void *data) {
+// Runs on a shared decode scheduler worker
+static void scheduled_decode(void *data, Decoder *decoder, DataPacket* data_packet) {
     droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
+    if (!decoder->failed)
+        decode_video_packet(plugin, decoder, data_packet);
 
-    Decoder *decoder = NULL;
-    DataPacket* data_packet = NULL;
-    bool got_output;
+    os_event_signal(plugin->drain_signal);
+}
 
-    ilog("video_decode_thread start");
+static enum DecodePriority decode_priority(droidcam_obs_source *plugin) {
+    if (plugin->standby || !plugin->visible) return DECODE_HIDDEN;
+    if (plugin->tally.on_program) return DECODE_PROGRAM;
+    if (plugin->tally.on_preview) return DECODE_PREVIEW;
+    return DECODE_VISIBLE;
+}
 
-    while (SOURCE_EXISTS()) {
-        if ((decoder = plugin->video_decoder) == NULL || (data_packet = decoder->pull_ready_packet()) == NULL) {
-            os_sleep_ms(5);
-            continue;
-        }
+// The scheduler's copy of the decoder pointer changes under its lock, and
+// a decoder is only freed once no worker can still be using it
+static void set_video_decoder(droidcam_obs_source *plugin, Decoder *decoder) {
+    plugin->video_decoder = decoder;
+    decode_scheduler_set_decoder(&plugin->decode_client, decoder);
 
-        if (decoder->failed)
-            goto LOOP;
+    std::lock_guard<std::mutex> guard(plugin->decoder_stats_lock);
+    plugin->decoder_stats[0] = 0;
+    plugin->decoder_stats_ns = 0;
+}
 
-        if (!decoder->decode_video(&plugin->obs_video_frame, data_packet, &got_output)) {
-            elog("error decoding video");
-            decoder->failed = true;
-            goto LOOP;
-        }
+// Queued mode decodes on the shared scheduler.
+// The source registers on its first queued connection.
+static bool start_video_decode_thread(droidcam_obs_source *plugin) {
+    if (plugin->decode_thread)
+        return true;
 
-        if (got_output) {
-            plugin->obs_video_frame.timestamp = data_packet->pts * 1000;
-            //if (flip) plugin->obs_video_frame.flip = !plugin->obs_video_frame.flip;
-            #if 0
-            dlog("output video: %dx%d %lu",
-                plugin->obs_video_frame.width,
-                plugin->obs_video_frame.height,
-                plugin->obs_video_frame.timestamp);
-            #endif
-            obs_source_output_video2(plugin->source, &plugin->obs_video_frame);
-        }
+    DecodeClient *client = &plugin->decode_client;
+    client->decode = scheduled_decode;
+    client->data = plugin;
+    client->decoder = plugin->video_decoder;
+    client->priority = decode_priority(plugin);
+    if (!decode_scheduler_add(client))
+        return false;
 
-        LOOP:
-        decoder->push_empty_packet(data_packet);
+    plugin->decode_thread = true;
+    return true;
+}
+
+// Wait until every packet is back from the decode queue
+static void drain_video_decoder(droidcam_obs_source *plugin, Decoder *decoder) {
+    size_t returned;
+    while ((returned = decoder->recieveQueue.size()) < decoder->alloc_count && SOURCE_EXISTS()) {
+        dlog("waiting for decode thread: %lu/%lu", returned, decoder->alloc_count);
+        os_sleep_ms(MILLI_SEC / FPS);
     }
 
-    ilog("video_decode_thread end");
-    return NULL;
+    if (plugin->decode_thread)
+        decode_scheduler_idle(&plugin->decode_client);
+}
+
+// Bytes waiting on the video socket, including any io_uring has read ahead
+static ssize_t video_pending(droidcam_obs_source *plugin, socket_t sock) {
+    return plugin->uring.active() ? plugin->uring.pending() : net_recv_pending(sock);
+}
+
+static bool inline_backlog(droidcam_obs_source *plugin, socket_t sock, DataPacket* data_packet) {
+    ssize_t pending = video_pending(plugin, sock);
+    if (!video_backlog(&plugin->avg_packet_size, data_packet->used, pending))
+        return false;
+
+    dlog("inline decode: %ld bytes backlog, skipping to next keyframe", (long) pending);
+    plugin->backlog_skips++;
+    return true;
+}
+
+// Tally-aware resolution: cameras that are neither on program nor on
+// preview stream at the idle resolution. Going to preview switches to
+// the full resolution right away, so the stream is already decoding
+// when the source is cut to program.
+// The adaptive quality level caps the result further.
+static int wanted_resolution(droidcam_obs_source *plugin) {
+    int res = plugin->video_resolution;
+
+    if (plugin->tally_resolution && !plugin->tally.on_program && !plugin->tally.on_preview
+        && plugin->idle_resolution < res)
+        res = plugin->idle_resolution;
+
+    if (plugin->adaptive_quality && plugin->quality_level < res)
+        res = plugin->quality_level;
+
+    return res;
+}
+
+#define TALLY_IDLE_DELAY_NS (NANO_SEC * 5ULL)
+
+static bool tally_resolution_changed(droidcam_obs_source *plugin) {
+    const int wanted = wanted_resolution(plugin);
+    if (wanted == plugin->stream_resolution) {
+        plugin->tally_idle_since = 0;
+        return false;
+    }
+
+    if (wanted > plugin->stream_resolution) {
+        ilog("tally: switching up to %s", Resolutions[wanted]);
+        return true;
+    }
+
+    // Only step down once the camera has stayed idle for a while,
+    // avoids thrashing on quick preview/program flips.
+    const uint64_t now = os_gettime_ns();
+    if (plugin->tally_idle_since == 0) {
+        plugin->tally_idle_since = now;
+        return false;
+    }
+
+    if ((now - plugin->tally_idle_since) < TALLY_IDLE_DELAY_NS)
+        return false;
+
+    ilog("tally: switching down to %s", Resolutions[wanted]);
+    return true;
+}
+
+// Adaptive quality: set the controller limits for a new connection.
+// The level carries over between connections unless the user picked
+// a different resolution.
+static void quality_connect(droidcam_obs_source *plugin) {
+    int cap = plugin->video_resolution;
+    if (plugin->quality_max < cap) cap = plugin->quality_max;
+
+    int floor = plugin->quality_min;
+    if (floor > cap) floor = cap;
+
+    if (plugin->quality_cap != cap) {
+        plugin->quality_cap = cap;
+        plugin->quality_level = cap;
+    }
+
+    plugin->quality.reset(floor, cap, plugin->quality_level);
+    plugin->quality_level = plugin->quality.level;
+    plugin->quality_reset = false;
+}
+
+// Feed the controller and, once it settles on a new level, reconnect at
+// the next keyframe so the switch lands on a GOP boundary.
+static bool quality_changed(droidcam_obs_source *plugin, Decoder *decoder, DataPacket* data_packet) {
+    QualityController *qc = &plugin->quality;
+
+    // nothing is decoded in standby, start measuring again on resume
+    if (plugin->standby) {
+        qc->restart();
+        return false;
+    }
+
+    const uint64_t floor_ns = plugin->media_clock.floor_time(data_packet->pts);
+    qc->on_packet(data_packet->used,
+        floor_ns && data_packet->recv_ns > floor_ns ? data_packet->recv_ns - floor_ns : 0);
+    const int level = qc->evaluate(data_packet->recv_ns, decoder->dropped + plugin->backlog_skips);
+    if (level == plugin->quality_level || !decoder->is_keyframe(data_packet))
+        return false;
+
+    plugin->quality_level = level;
+    if (wanted_resolution(plugin) == plugin->stream_resolution)
+        return false;
+
+    ilog("quality: switching to %s", Resolutions[wanted_resolution(plugin)]);
+    plugin->quality_reset = true;
+    return true;
+}
+
+static void set_decimator_rate(droidcam_obs_source *plugin) {
+    struct obs_video_info ovi;
+    if (obs_get_video_info(&ovi))
+        plugin->decimator.set_rate(ovi.fps_num, ovi.fps_den);
+    else
+        plugin->decimator.set_rate(0, 0);
+}
+
+// Backpressure: with the decode queue backed up, leave the socket unread
+// rather than reading and discarding. The TCP receive window closes and
+// the phone's sender stalls, or its encoder adapts.
+#define BACKPRESSURE_DEPTH 3
+#define BACKPRESSURE_MAX_NS (NANO_SEC * 2ULL)
+
+static void apply_backpressure(droidcam_obs_source *plugin, Decoder *decoder) {
+    const uint64_t limit_ns = (uint64_t) plugin->backpressure_ms * 1000000ULL;
+    uint64_t wait_ns;
+    uint64_t now = os_gettime_ns();
+    size_t depth = decoder->queued(now, &wait_ns);
+
+    if (depth < BACKPRESSURE_DEPTH && wait_ns < limit_ns)
+        return;
+
+    // Resume once the decoder has mostly caught up. The limit keeps
+    // the phone from timing out a connection that stays closed, and a
+    // reset (settings, stream switch, quality step) does not wait.
+    const uint64_t start = now;
+    plugin->throttled = true;
+    plugin->throttle_events++;
+    os_event_reset(plugin->drain_signal);
+    while (SOURCE_EXISTS() && plugin->activated && (now - start) < BACKPRESSURE_MAX_NS
+        && os_event_try(plugin->reset_signal) == EAGAIN)
+    {
+        os_event_timedwait(plugin->drain_signal, 10);
+        now = os_gettime_ns();
+        depth = decoder->queued(now, &wait_ns);
+        if (depth <= 1 && wait_ns < limit_ns / 2)
+            break;
+    }
+
+    plugin->throttled = false;
+    plugin->throttled_ns += now - start;
+}
+
+// Keep the stream's SPS/PPS and flag the packet when they change
+static void check_video_config(droidcam_obs_source *plugin, DataPacket *data_packet, int len) {
+    if (len > (int) sizeof(plugin->video_config))
+        return;
+
+    if (plugin->video_config_len
+        && (len != plugin->video_config_len || memcmp(plugin->video_config, data_packet->data, len) != 0))
+    {
+        ilog("video: codec config changed");
+        data_packet->new_config = true;
+        plugin->config_changes++;
+    }
+
+    plugin->video_config_lock.lock();
+    memcpy(plugin->video_config, data_packet->data, len);
+    plugin->video_config_len = len;
+    plugin->video_config_lock.unlock();
 }
 
 static bool
@@ -296,30 +743,53 @@ recv_video_frame(droidcam_obs_source *plugin, socket_t sock) {
     int has_config = 0;
     DataPacket* data_packet;
     Decoder *decoder = plugin->video_decoder;
+    ChunkFeed feed;
+    ChunkFeed *chunked = NULL;
 
     if (!decoder) {
-        if (plugin->video_format == FORMAT_AVC) {
-            decoder = new FFMpegDecoder();
-        }
-        else if (plugin->video_format == FORMAT_MJPG) {
-            decoder = new MJpegDecoder();
-        }
-        else {
-            elog("unexpected video format %d", plugin->video_format);
-            decoder = new MJpegDecoder();
-            decoder->failed = true;
-        }
-        plugin->video_decoder = decoder;
+        decoder = create_video_decoder(plugin->video_format, plugin->chunked_decode);
+        set_video_decoder(plugin, decoder);
+    }
+
+    // Stream the next frame into the decoder only when it is
+    // certain to be decoded in full; otherwise take the normal path.
+    if (plugin->chunked_decode && decoder->ready && !decoder->failed && !plugin->decode_recovering
+        && !plugin->standby && !plugin->wait_keyframe && !plugin->quality_reset
+        && !plugin->decimator.active && video_pending(plugin, sock) < INLINE_BACKLOG_MIN)
+    {
+        memset(&feed, 0, sizeof(feed));
+        feed.decode = decode_video_chunk;
+        feed.plugin = plugin;
+        feed.decoder = decoder;
+        chunked = &feed;
     }
 
-    data_packet = read_frame(decoder, sock, &has_config);
+    if (plugin->backpressure_ms > 0 && !plugin->inline_decode
+        && decoder->ready && !decoder->failed)
+        apply_backpressure(plugin, decoder);
+
+    data_packet = read_frame(decoder, sock, &has_config, chunked,
+        plugin->uring.active() ? &plugin->uring : NULL);
     if (!data_packet)
         return false;
 
+    plugin->video_frames++;
+
     // NOTE: data_packet must be properly disposed from here
+    data_packet->recv_ns = os_gettime_ns();
+    plugin->media_clock.update(data_packet->pts, data_packet->recv_ns);
 
-    // Decoder failures should not happen generally.
-    // Rather than causing a connection reset, just idle
+    // Out of decode retries: start over on a new connection
+    if (plugin->decode_gave_up) {
+        decoder->push_empty_packet(data_packet);
+        return false;
+    }
+
+    if (has_config)
+        check_video_config(plugin, data_packet, has_config);
+
+    // A decoder that does not initialize is not going to recover.
+    // Rather than reconnecting over and over, just idle
     if (decoder->failed) {
         FAILED:
         dlog("discarding frame.. decoder failed");
@@ -329,25 +799,20 @@ recv_video_frame(droidcam_obs_source *plugin, socket_t sock) {
 
 
     if (!decoder->ready) {
-        bool init = false;
-        bool use_hw = plugin->use_hw;
-        dlog("init video decoder");
-
-        if (plugin->video_format == FORMAT_AVC) {
-            init = (((FFMpegDecoder*)decoder)->init(NULL, AV_CODEC_ID_H264, use_hw) >= 0);
-        }
-        else if (plugin->video_format == FORMAT_MJPG) {
-            init = ((MJpegDecoder*)decoder)->init();
-        }
-        else {
-            init = false;
-        }
+        bool init = init_video_decoder(decoder, plugin->video_format, plugin->use_hw,
+            plugin->mjpeg_backend);
+        set_decimator_rate(plugin);
 
         plugin->obs_video_frame.format = VIDEO_FORMAT_NONE;
         plugin->obs_video_frame.range  = VIDEO_RANGE_DEFAULT;
         if (init) {
             comms_task(CommsTask::TALLY);
             droidcam_signal(plugin->source, "droidcam_connect");
+            replay_start(plugin);
+            if (plugin->iso_record)
+                iso_start(plugin, true);
+            else
+                plugin->iso.stop();
         } else {
             elog("could not initialize decoder");
             decoder->failed = true;
@@ -355,17 +820,129 @@ recv_video_frame(droidcam_obs_source *plugin, socket_t sock) {
         }
     }
 
+    // The ISO recording gets every packet, before any dropping below
+    if (plugin->iso.running) {
+        // the new config goes in a new file
+        if (data_packet->new_config)
+            iso_start(plugin, true);
+        if (has_config)
+            plugin->iso.set_video_config(data_packet->data, has_config);
+
+        plugin->iso.write(data_packet->data, data_packet->used, data_packet->pts,
+            true, decoder->is_keyframe(data_packet));
+    }
+
+    if (plugin->replay.enabled()) {
+        if (has_config)
+            plugin->replay.set_video_config(data_packet->data, has_config);
+
+        plugin->replay.write(data_packet->data, data_packet->used, data_packet->pts,
+            true, decoder->is_keyframe(data_packet));
+    }
+
+    if (plugin->adaptive_quality && quality_changed(plugin, decoder, data_packet)) {
+        decoder->push_empty_packet(data_packet);
+        return true;
+    }
+
+    // already decoded while it was received
+    if (chunked) {
+        if (plugin->adaptive_quality)
+            plugin->quality.on_decode(feed.decode_ns, 0);
+
+        decoder->push_empty_packet(data_packet);
+        return true;
+    }
+
+    if (plugin->inline_decode && inline_backlog(plugin, sock, data_packet)) {
+        plugin->wait_keyframe = true;
+        decoder->push_empty_packet(data_packet);
+        return true;
+    }
+
+    // Hidden source in standby: the link stays up, only decode
+    // what is needed to hold a recent frame.
+    if (plugin->standby) {
+        uint64_t now = os_gettime_ns();
+        if (plugin->standby_mode == STANDBY_NO_DECODE
+            || !decoder->is_keyframe(data_packet)
+            || (now - plugin->standby_last_ns) < NANO_SEC)
+        {
+            plugin->standby_skipped++;
+            plugin->wait_keyframe = true;
+            decoder->push_empty_packet(data_packet);
+            return true;
+        }
+
+        plugin->standby_last_ns = now;
+    }
+    else if (plugin->wait_keyframe) {
+        // Resuming from standby or a skip, references are missing until the next IDR
+        if (!decoder->is_keyframe(data_packet)) {
+            decoder->push_empty_packet(data_packet);
+            return true;
+        }
+
+        dlog("resumed on keyframe");
+        plugin->wait_keyframe = false;
+    }
+
+    // Decimate to the canvas rate as early as possible. Frames nothing
+    // depends on are dropped here, reference frames are still decoded
+    // but skip conversion and output.
+    if (!plugin->standby && plugin->match_canvas_fps
+        && !plugin->decimator.keep(&data_packet->pts))
+    {
+        if (!decoder->is_reference(data_packet)) {
+            decoder->push_empty_packet(data_packet);
+            return true;
+        }
+
+        data_packet->skip_output = true;
+    }
+
+    if (plugin->inline_decode) {
+        decode_video_packet(plugin, decoder, data_packet);
+        decoder->push_empty_packet(data_packet);
+        return true;
+    }
+
+    plugin->decode_client.priority = decode_priority(plugin);
     decoder->push_ready_packet(data_packet);
+    decode_scheduler_signal();
     return true;
 }
 
-static void *video_thread(void *data) {
-    droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
+// Applied by each thread to itself, again whenever the settings change
+static void tune_thread(droidcam_obs_source *plugin, const char *name,
+    struct ThreadState *state, long *gen)
+{
+    if (*gen == plugin->tuning_gen)
+        return;
+
+    *gen = plugin->tuning_gen;
+    struct ThreadTuning tuning = plugin->thread_tuning;
+    if (tuning.sched == THREAD_SCHED_GLOBAL)
+        tuning = thread_defaults;
+
+    thread_tuning_apply(name, &tuning, state);
+}
+
+static void read_thread_tuning(droidcam_obs_source *plugin, obs_data_t *settings) {
+    struct ThreadTuning *tuning = &plugin->thread_tuning;
+    tuning->sched = (int) obs_data_get_int(settings, OPT_THREAD_SCHED);
+    tuning->nice = (int) obs_data_get_int(settings, OPT_THREAD_NICE);
+    snprintf(tuning->affinity, sizeof(tuning->affinity), "%s",
+        obs_data_get_string(settings, OPT_THREAD_AFFINITY));
+    plugin->tuning_gen++;
+}
+
+// Open a video stream and send the request for it
+static socket_t video_connect(droidcam_obs_source *plugin, enum VideoFormat format, int resolution) {
     const char *obs_version_str = obs_get_version_string();
-    socket_t sock = INVALID_SOCKET;
-    char remote_url[256];
     char video_req[256];
-    int video_req_len = 0;
+    int video_req_len;
+    socket_t sock;
 
     #if DROIDCAM_OVERRIDE
     // todo: dont do this
@@ -376,7 +953,351 @@ static void *video_thread(void *data) {
     obs_version_str_flat[3] = 0;
     #endif
 
+    if ((sock = connect(plugin, true)) == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    video_req_len = snprintf(video_req, sizeof(video_req), VIDEO_REQ,
+        VideoFormatNames[format][1],
+        Resolutions[resolution],
+        plugin->usb_port,
+        os_name_version,
+        #if DROIDCAM_OVERRIDE
+        "", obs_version_str_flat, 5912);
+        #else
+        obs_version_str, PLUGIN_VERSION_STR, 5912);
+        #endif
+
+    dlog("%s", video_req);
+    if (net_send_all(sock, video_req, video_req_len) <= 0) {
+        elog("send(/video) failed");
+        net_close(sock);
+        return INVALID_SOCKET;
+    }
+
+    set_recv_buf_len(sock, 65536 * 4);
+    return sock;
+}
+
+// Decode mode is fixed for the lifetime of a stream
+static void latch_pipeline_mode(droidcam_obs_source *plugin) {
+    plugin->inline_decode = (plugin->pipeline_mode != PIPELINE_QUEUED);
+    plugin->chunked_decode = (plugin->pipeline_mode == PIPELINE_CHUNKED
+        && plugin->video_format == FORMAT_AVC);
+    if (!plugin->inline_decode && !start_video_decode_thread(plugin)) {
+        elog("error starting video decode thread, decoding inline");
+        plugin->inline_decode = true;
+    }
+
+    plugin->video_latency_ns = 0;
+    plugin->avg_packet_size = 0;
+    plugin->video_config_lock.lock();
+    plugin->video_config_len = 0;
+    plugin->video_config_lock.unlock();
+    plugin->decode_recovering = false;
+    plugin->decode_gave_up = false;
+    plugin->decode_errors = 0;
+}
+
+// The receive backend is also fixed per stream
+static void start_recv_backend(droidcam_obs_source *plugin, socket_t sock) {
+    plugin->uring.close();
+    plugin->video_frames = 0;
+    if (plugin->uring_recv && plugin->uring.init(sock)) {
+        plugin->uring.syscalls = 0;
+        plugin->uring.completions = 0;
+        plugin->uring.bytes = 0;
+    }
+}
+
+// The worker reads the video socket itself, so the features that work
+// on the received packets in process get nothing. Lists those turned on.
+static void worker_bypassed(droidcam_obs_source *plugin, char *buf, size_t size) {
+    const struct { bool on; const char *name; } features[] = {
+        {plugin->iso_record, "iso"},
+        {plugin->replay.enabled(), "replay"},
+        {plugin->match_canvas_fps, "match_canvas_fps"},
+        {plugin->backpressure_ms > 0, "backpressure"},
+        {plugin->chunked_decode, "chunked"},
+    };
+
+    size_t len = 0;
+    buf[0] = 0;
+    for (size_t i = 0; i < ARRAY_LEN(features) && len < size; i++) {
+        if (features[i].on)
+            len += snprintf(&buf[len], size - len, "%s%s", len ? "," : "", features[i].name);
+    }
+}
+
+// Hand the new connection to a decode worker. false decodes in process.
+static bool start_decode_worker(droidcam_obs_source *plugin, socket_t sock) {
+    char *exe = obs_module_file(WORKER_EXE);
+    if (!exe) {
+        elog("worker: %s not found, decoding in process", WORKER_EXE);
+        return false;
+    }
+
+    bool ok = plugin->worker.start(exe, sock, plugin->video_format, plugin->use_hw,
+        plugin->mjpeg_backend);
+    bfree(exe);
+    if (!ok)
+        return false;
+
+    char bypassed[128];
+    worker_bypassed(plugin, bypassed, sizeof(bypassed));
+    if (bypassed[0])
+        elog("worker: %s not available with the decode worker", bypassed);
+
+    plugin->worker_restart = false;
+    comms_task(CommsTask::TALLY);
+    droidcam_signal(plugin->source, "droidcam_connect");
+    return true;
+}
+
+// Frames decoded by the worker are output straight from the ring.
+// The wait is short so the video thread still sees resets quickly.
+static bool recv_worker_frame(droidcam_obs_source *plugin) {
+    DecodeWorker *worker = &plugin->worker;
+    uint64_t pts, recv_ns;
+
+    if (!worker->next_frame(&plugin->obs_video_frame, &pts, &recv_ns, MILLI_SEC / 10)) {
+        if (worker->alive())
+            return true;
+
+        // A crashed worker is replaced on a new connection right away,
+        // unless it keeps crashing
+        plugin->worker_restart = worker->should_restart();
+        return false;
+    }
+
+    plugin->video_frames++;
+    plugin->media_clock.update(pts, recv_ns);
+    if (plugin->standby) {
+        plugin->standby_skipped++;
+        return true;
+    }
+
+    output_video_frame(plugin, pts, recv_ns);
+    return true;
+}
+
+// Keep the last frame on screen through a brief outage. The copy
+// outlives the decoder's buffers, and a new frame on reconnect
+// simply replaces it.
+static void hold_last_frame(droidcam_obs_source *plugin) {
+    if (plugin->hold_ms > 0 && plugin->activated && plugin->is_showing
+        && !plugin->video_blank && plugin->hold.copy(&plugin->obs_video_frame))
+    {
+        const uint64_t now = os_gettime_ns();
+        dlog("holding last frame for %dms", plugin->hold_ms);
+        plugin->hold.frame.timestamp = now;
+        obs_source_output_video2(plugin->source, &plugin->hold.frame);
+        plugin->hold_until = now + (uint64_t) plugin->hold_ms * 1000000ULL;
+    }
+}
+
+static void *release_decoder_thread(void *data) {
+    delete (Decoder*)(data);
+    return NULL;
+}
+
+// Decoder teardown (hw contexts in particular) can take a while
+static void release_decoder(Decoder *decoder) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, release_decoder_thread, decoder) == 0)
+        pthread_detach(thread);
+    else
+        delete decoder;
+}
+
+// How long the new stream gets to produce a frame
+#define SWITCH_TIMEOUT_NS (NANO_SEC * 3ULL)
+
+// The old stream while a switch is under way: recorded and output as
+// usual, but with no backpressure, quality steps or decimation, which
+// only concern the stream being replaced.
+static bool recv_switch_frame(droidcam_obs_source *plugin, socket_t sock) {
+    int has_config = 0;
+    Decoder *decoder = plugin->video_decoder;
+    DataPacket *data_packet = read_frame(decoder, sock, &has_config, NULL,
+        plugin->uring.active() ? &plugin->uring : NULL);
+    if (!data_packet)
+        return false;
+
+    plugin->video_frames++;
+    data_packet->recv_ns = os_gettime_ns();
+    plugin->media_clock.update(data_packet->pts, data_packet->recv_ns);
+
+    const bool keyframe = decoder->is_keyframe(data_packet);
+    if (plugin->iso.running) {
+        if (has_config)
+            plugin->iso.set_video_config(data_packet->data, has_config);
+        plugin->iso.write(data_packet->data, data_packet->used, data_packet->pts, true, keyframe);
+    }
+
+    if (plugin->replay.enabled()) {
+        if (has_config)
+            plugin->replay.set_video_config(data_packet->data, has_config);
+        plugin->replay.write(data_packet->data, data_packet->used, data_packet->pts, true, keyframe);
+    }
+
+    if (plugin->standby || (plugin->wait_keyframe && !keyframe)) {
+        decoder->push_empty_packet(data_packet);
+        return true;
+    }
+
+    plugin->wait_keyframe = false;
+    if (plugin->inline_decode) {
+        decode_video_packet(plugin, decoder, data_packet);
+        decoder->push_empty_packet(data_packet);
+        return true;
+    }
+
+    plugin->decode_client.priority = decode_priority(plugin);
+    decoder->push_ready_packet(data_packet);
+    decode_scheduler_signal();
+    return true;
+}
+
+// Make-before-break format/resolution change: open the new stream next
+// to the running one and keep outputting the old one until the new
+// decoder has produced a frame, then swap them over.
+// Returns the new socket, or INVALID_SOCKET with the old stream left as
+// is when the caller should fall back to a plain reconnect.
+static socket_t switch_video_stream(droidcam_obs_source *plugin, socket_t old_sock) {
+    Decoder *old_decoder = plugin->video_decoder;
+    Decoder *decoder = NULL;
+    DataPacket *packet;
+    std::vector<DataPacket*> held;
+    struct obs_source_frame2 frame;
+    uint8_t config[ISO_CONFIG_MAX];
+    int config_len = 0;
+    int has_config;
+    uint64_t pts = 0;
+    uint64_t recv_ns = 0;
+    bool old_running = true;
+    bool got_output = false;
+    bool ok;
+
+    if (!old_decoder || !old_decoder->ready || old_decoder->failed)
+        return INVALID_SOCKET;
+
+    os_event_reset(plugin->reset_signal);
+    if (plugin->adaptive_quality)
+        quality_connect(plugin);
+
+    const enum VideoFormat format = plugin->video_format;
+    const int resolution = wanted_resolution(plugin);
+    const uint64_t deadline = os_gettime_ns() + SWITCH_TIMEOUT_NS;
+    ilog("switching video to %s %s", VideoFormatNames[format][1], Resolutions[resolution]);
+
+    socket_t sock = video_connect(plugin, format, resolution);
+    if (sock == INVALID_SOCKET)
+        goto FAILED;
+
+    decoder = create_video_decoder(format,
+        plugin->pipeline_mode == PIPELINE_CHUNKED && format == FORMAT_AVC);
+    if (decoder->failed || !init_video_decoder(decoder, format, plugin->use_hw, plugin->mjpeg_backend))
+        goto FAILED;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.format = VIDEO_FORMAT_NONE;
+    frame.range  = VIDEO_RANGE_DEFAULT;
+
+    while (!got_output) {
+        if (!SOURCE_EXISTS() || !plugin->activated || os_gettime_ns() > deadline)
+            goto FAILED;
+
+        // the old stream keeps the output going meanwhile
+        if (old_running && !(old_running = recv_switch_frame(plugin, old_sock)))
+            dlog("switch: old stream ended");
+
+        while (!got_output && (!old_running || net_recv_pending(sock) >= HEADER_SIZE)) {
+            packet = read_frame(decoder, sock, &has_config);
+            if (!packet)
+                goto FAILED;
+
+            // kept for the ISO recording of the new stream
+            if (has_config && has_config <= (int) sizeof(config)) {
+                memcpy(config, packet->data, has_config);
+                config_len = has_config;
+            }
+
+            // held for the recording and replay, which start after the swap
+            pts = packet->pts;
+            recv_ns = os_gettime_ns();
+            ok = decoder->decode_video(&frame, packet, &got_output);
+            held.push_back(packet);
+            if (!ok)
+                goto FAILED;
+        }
+    }
+
+    // Let packets already queued on the old stream finish, then swap
+    plugin->uring.close();
+    net_close(old_sock);
+    drain_video_decoder(plugin, old_decoder);
+
+    // No worker holds the old decoder once this returns
+    set_video_decoder(plugin, decoder);
+    plugin->obs_video_frame = frame;
+    plugin->stream_resolution = resolution;
+    plugin->tally_idle_since = 0;
+    plugin->wait_keyframe = false;
+    plugin->media_clock.reset();
+    set_decimator_rate(plugin);
+    latch_pipeline_mode(plugin);
+    start_recv_backend(plugin, sock);
+    output_video_frame(plugin, pts, recv_ns);
+
+    replay_start(plugin);
+    if (config_len) {
+        plugin->video_config_lock.lock();
+        memcpy(plugin->video_config, config, config_len);
+        plugin->video_config_len = config_len;
+        plugin->video_config_lock.unlock();
+        plugin->replay.set_video_config(config, config_len);
+    }
+
+    if (plugin->iso_record) {
+        iso_start(plugin, true);
+        if (config_len)
+            plugin->iso.set_video_config(config, config_len);
+    }
+    else {
+        plugin->iso.stop();
+    }
+
+    // The new stream's first packets, its config and keyframe included
+    for (DataPacket *p : held) {
+        const bool keyframe = decoder->is_keyframe(p);
+        if (plugin->iso.running)
+            plugin->iso.write(p->data, p->used, p->pts, true, keyframe);
+        if (plugin->replay.enabled())
+            plugin->replay.write(p->data, p->used, p->pts, true, keyframe);
+        decoder->push_empty_packet(p);
+    }
+
+    release_decoder(old_decoder);
+    plugin->stream_switches++;
+    ilog("switched video stream (socket %d)", sock);
+    return sock;
+
+FAILED:
+    elog("video switch failed, reconnecting");
+    plugin->switch_fallbacks++;
+    if (sock != INVALID_SOCKET) net_close(sock);
+    for (DataPacket *p : held) decoder->push_empty_packet(p);
+    if (decoder) delete decoder;
+    return INVALID_SOCKET;
+}
+
+static void *video_thread(void *data) {
+    droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
+    socket_t sock = INVALID_SOCKET;
+    char remote_url[256];
+
 
+    long tuning_gen = -1;
     ilog("video_thread start");
 
     // Preload devices if plugin is created already active
@@ -403,45 +1324,55 @@ static void *video_thread(void *data) {
     }
 
     while (SOURCE_EXISTS()) {
-        if (plugin->activated && plugin->is_showing) {
+        tune_thread(plugin, "droidcam-video", &plugin->video_thread_state, &tuning_gen);
+        if (plugin->activated && plugin->is_showing && !plugin->audio_only) {
             if (plugin->video_running) {
-                if (os_event_try(plugin->reset_signal) == EAGAIN
-                    && recv_video_frame(plugin, sock))
+                bool reset = os_event_try(plugin->reset_signal) != EAGAIN
+                    || plugin->quality_reset
+                    || tally_resolution_changed(plugin);
+
+                if (!reset && (plugin->worker_stream
+                    ? recv_worker_frame(plugin)
+                    : recv_video_frame(plugin, sock)))
                     continue;
 
+                if (reset) {
+                    socket_t next = switch_video_stream(plugin, sock);
+                    if (next != INVALID_SOCKET) {
+                        sock = next;
+                        continue;
+                    }
+                }
+
                 plugin->video_running = false;
-                dlog("closing failed video socket %d", sock);
+                dlog("closing %s video socket %d", reset ? "active" : "failed", sock);
+                plugin->uring.close();
                 net_close(sock);
                 sock = INVALID_SOCKET;
-                goto SLOW_LOOP;
-            }
 
-            if ((sock = connect(plugin)) == INVALID_SOCKET)
+                // a requested reset reconnects right away, as does a
+                // crashed worker
+                if (reset || plugin->worker_restart) goto LOOP;
                 goto SLOW_LOOP;
+            }
 
-            video_req_len = snprintf(video_req, sizeof(video_req), VIDEO_REQ,
-                VideoFormatNames[plugin->video_format][1],
-                Resolutions[plugin->video_resolution],
-                plugin->usb_port,
-                os_name_version,
-                #if DROIDCAM_OVERRIDE
-                "", obs_version_str_flat, 5912);
-                #else
-                obs_version_str, PLUGIN_VERSION_STR, 5912);
-                #endif
-
-            dlog("%s", video_req);
-            if (net_send_all(sock, video_req, video_req_len) <= 0) {
-                elog("send(/video) failed");
-                net_close(sock);
-                sock = INVALID_SOCKET;
+            if (plugin->adaptive_quality)
+                quality_connect(plugin);
 
+            plugin->stream_resolution = wanted_resolution(plugin);
+            plugin->tally_idle_since = 0;
+            sock = video_connect(plugin, plugin->video_format, plugin->stream_resolution);
+            if (sock == INVALID_SOCKET) {
                 SLOW_LOOP:
                 os_sleep_ms(MILLI_SEC * 2);
                 goto LOOP;
             }
 
-            set_recv_buf_len(sock, 65536 * 4);
+            latch_pipeline_mode(plugin);
+            plugin->media_clock.reset();
+            plugin->worker_stream = plugin->decode_worker && start_decode_worker(plugin, sock);
+            if (!plugin->worker_stream)
+                start_recv_backend(plugin, sock);
             plugin->video_running = true;
             dlog("starting video via socket %d", sock);
 
@@ -461,7 +1392,6 @@ static void *video_thread(void *data) {
             continue;
         }
         // else: not activated
-        video_req_len = 0;
 
         LOOP:
         if (plugin->video_running) {
@@ -470,29 +1400,67 @@ static void *video_thread(void *data) {
 
         if (sock != INVALID_SOCKET) {
             dlog("closing active video socket %d", sock);
+            plugin->uring.close();
             net_close(sock);
             sock = INVALID_SOCKET;
         }
 
+        // The last frame's slot stays intact once the worker is gone
+        if (plugin->worker_stream) {
+            plugin->worker.stop();
+            droidcam_signal(plugin->source, "droidcam_disconnect");
+            hold_last_frame(plugin);
+            plugin->media_clock.reset();
+            plugin->worker_stream = false;
+        }
+
         if (plugin->video_decoder) {
             if (plugin->video_decoder->ready)
                 droidcam_signal(plugin->source, "droidcam_disconnect");
 
-            while (plugin->video_decoder->recieveQueue.items.size() < plugin->video_decoder->alloc_count
-                    && SOURCE_EXISTS())
-            {
-                dlog("waiting for decode thread: %lu/%lu",
-                    plugin->video_decoder->recieveQueue.items.size(),
-                    plugin->video_decoder->alloc_count);
-                os_sleep_ms(MILLI_SEC / FPS);
-            }
+            drain_video_decoder(plugin, plugin->video_decoder);
+
+            if (!iso_continues(plugin) || plugin->audio_only)
+                plugin->iso.stop();
+            hold_last_frame(plugin);
 
             dlog("release video_decoder");
-            delete plugin->video_decoder;
-            plugin->video_decoder = NULL;
+            Decoder *decoder = plugin->video_decoder;
+            set_video_decoder(plugin, NULL);
+            delete decoder;
+            plugin->wait_keyframe = false;
+
+            FrameDecimator *dec = &plugin->decimator;
+            if (dec->frames_in != dec->frames_out) {
+                ilog("decimation: in=%llu out=%llu ratio=%.2f",
+                    (unsigned long long) dec->frames_in,
+                    (unsigned long long) dec->frames_out, dec->ratio());
+            }
+
+            MediaClock *clock = &plugin->media_clock;
+            if (clock->locked) {
+                ilog("media clock: drift=%.1fppm jitter=%.2fms latency=%.1fms resets=%llu",
+                    clock->drift_ppm(), clock->jitter_ms(), clock->latency_ms(),
+                    (unsigned long long) clock->resets);
+                clock->reset();
+            }
+        }
+
+        if (plugin->hold_until) {
+            if (plugin->activated && os_gettime_ns() < plugin->hold_until)
+                goto SLEEP;
+
+            dlog("last frame hold ended");
+            plugin->hold_until = 0;
+        }
+
+        // Blank once, repeated NULL frames only make OBS drop its frame cache
+        if (!plugin->video_blank) {
+            obs_source_output_video2(plugin->source, NULL);
+            plugin->video_blank = true;
         }
 
-        obs_source_output_video2(plugin->source, NULL);
+        SLEEP:
         os_sleep_ms(MILLI_SEC / FPS);
     }
 
@@ -512,7 +1480,6 @@ do_audio_frame(droidcam_obs_source *plugin, socket_t sock) {
     }
 
     int has_config = 0;
-    bool got_output;
     DataPacket* data_packet = read_frame(decoder, sock, &has_config);
     if (!data_packet)
         return false;
@@ -542,33 +1509,115 @@ do_audio_frame(droidcam_obs_source *plugin, socket_t sock) {
         }
 
         plugin->obs_audio_frame.format = AUDIO_FORMAT_UNKNOWN;
+        plugin->obs_audio_frame.speakers = SPEAKERS_UNKNOWN;
+
+        // Keep the ASC for ISO recordings, channels as parsed by init()
+        if (has_config >= 2) {
+            plugin->iso.set_audio_config(data_packet->data, has_config,
+                decoder->decoder->sample_rate, (data_packet->data[1] >> 3) & 0xF);
+            plugin->replay.set_audio_config(data_packet->data, has_config,
+                decoder->decoder->sample_rate, (data_packet->data[1] >> 3) & 0xF);
+        }
+
+        if (plugin->audio_only && plugin->iso_record)
+            iso_start(plugin, false);
+        else if (plugin->audio_only)
+            plugin->iso.stop();
+
         decoder->push_empty_packet(data_packet);
         return true;
     }
 
+    // Decoding and output happens on audio_decode_thread,
+    // paced by the jitter buffer.
+    plugin->media_clock.update(data_packet->pts, os_gettime_ns());
+    if (plugin->iso.running)
+        plugin->iso.write(data_packet->data, data_packet->used, data_packet->pts, false, true);
+    if (plugin->replay.enabled())
+        plugin->replay.write(data_packet->data, data_packet->used, data_packet->pts, false, true);
 
-    // decoder->push_ready_packet(data_packet);
-    if (!decoder->decode_audio(&plugin->obs_audio_frame, data_packet, &got_output)) {
-        elog("error decoding audio");
-        decoder->failed = true;
-        goto FAILED;
-    }
+    decoder->push_ready_packet(data_packet);
+    return true;
+}
 
-    if (got_output) {
-        plugin->obs_audio_frame.timestamp = os_gettime_ns(); // data_packet->pts * 1000;
-        #if 0
-        dlog("output audio: %d frames: %d HZ, Fmt %d, Chan %d,  pts %lu",
-            plugin->obs_audio_frame.frames,
-            plugin->obs_audio_frame.samples_per_sec,
-            plugin->obs_audio_frame.format,
-            plugin->obs_audio_frame.speakers,
-            plugin->obs_audio_frame.timestamp);
-        #endif
-        obs_source_output_audio(plugin->source, &plugin->obs_audio_frame);
+static void *audio_decode_thread(void *data) {
+    droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
+    AudioJitterBuffer *jb = &plugin->audio_buffer;
+    DataPacket* data_packet;
+    uint64_t due;
+    bool got_output;
+
+    long tuning_gen = -1;
+    ilog("audio_decode_thread start");
+
+    while (SOURCE_EXISTS()) {
+        tune_thread(plugin, "droidcam-adec", &plugin->audio_decode_state, &tuning_gen);
+        plugin->audio_decoder_lock.lock();
+        FFMpegDecoder *decoder = (FFMpegDecoder*)plugin->audio_decoder;
+
+        if (!decoder || !decoder->ready || decoder->failed) {
+            if (jb->decoder) jb->reset(NULL, 0);
+            plugin->audio_decoder_lock.unlock();
+            os_sleep_ms(5);
+            continue;
+        }
+
+        if (jb->decoder != decoder)
+            jb->reset(decoder, decoder->decoder->sample_rate);
+
+        if (plugin->sync_av) {
+            jb->clock = &plugin->media_clock;
+            plugin->media_clock.min_latency = (double) jb->target_ms * 1000000.0;
+        } else {
+            jb->clock = NULL;
+            plugin->media_clock.min_latency = 0;
+        }
+
+        due = jb->next_due();
+        if (due == 0 || due > os_gettime_ns()) {
+            plugin->audio_decoder_lock.unlock();
+            if (due) os_sleepto_ns(due);
+            else     os_sleep_ms(5);
+            continue;
+        }
+
+        if ((data_packet = jb->pull()) != NULL) {
+            jb->anchor(data_packet->pts);
+            if (!decoder->decode_audio(&plugin->obs_audio_frame, data_packet, &got_output)) {
+                elog("error decoding audio");
+                decoder->failed = true;
+                got_output = false;
+            }
+            decoder->push_empty_packet(data_packet);
+        }
+        else {
+            got_output = jb->conceal(&plugin->obs_audio_frame);
+        }
+
+        if (got_output) {
+            plugin->obs_audio_frame.timestamp = jb->advance(plugin->obs_audio_frame.frames);
+            if (plugin->sync.group > 0)
+                plugin->obs_audio_frame.timestamp += sync_group_delay_ns(&plugin->sync);
+            #if 0
+            dlog("output audio: %d frames: %d HZ, Fmt %d, Chan %d,  pts %lu",
+                plugin->obs_audio_frame.frames,
+                plugin->obs_audio_frame.samples_per_sec,
+                plugin->obs_audio_frame.format,
+                plugin->obs_audio_frame.speakers,
+                plugin->obs_audio_frame.timestamp);
+            #endif
+            obs_source_output_audio(plugin->source, &plugin->obs_audio_frame);
+        }
+        else {
+            // nothing to play yet, keep the clock moving
+            jb->advance(jb->frame_samples);
+        }
+
+        plugin->audio_decoder_lock.unlock();
     }
 
-    decoder->push_empty_packet(data_packet);
-    return true;
+    ilog("audio_decode_thread end");
+    return NULL;
 }
 
 static void *audio_thread(void *data) {
@@ -576,9 +1625,11 @@ static void *audio_thread(void *data) {
     socket_t sock = INVALID_SOCKET;
     const char *audio_req = AUDIO_REQ;
 
+    long tuning_gen = -1;
     ilog("audio_thread start");
     while (SOURCE_EXISTS()) {
-        if (plugin->activated && plugin->is_showing && plugin->enable_audio) {
+        tune_thread(plugin, "droidcam-audio", &plugin->audio_thread_state, &tuning_gen);
+        if (plugin->activated && plugin->is_showing && (plugin->enable_audio || plugin->audio_only)) {
             if (plugin->audio_running) {
                 if (do_audio_frame(plugin, sock)) {
                     continue;
@@ -592,11 +1643,13 @@ static void *audio_thread(void *data) {
             }
 
             // connect audio only after video works
-            if (!plugin->video_running)
-                goto LOOP;
+            if (!plugin->audio_only) {
+                if (!plugin->video_running)
+                    goto LOOP;
 
-            // no rush..
-            os_sleep_ms(MILLI_SEC);
+                // no rush..
+                os_sleep_ms(MILLI_SEC);
+            }
 
             if ((sock = connect(plugin)) == INVALID_SOCKET)
                 goto SLOW_LOOP;
@@ -613,12 +1666,22 @@ static void *audio_thread(void *data) {
 
             plugin->audio_running = true;
             dlog("starting audio via socket %d", sock);
+
+            // There is no video decoder to kick off the comms channel,
+            // nor a video stream to reset the clock
+            if (plugin->audio_only) {
+                plugin->media_clock.reset();
+                comms_task(CommsTask::TALLY);
+                droidcam_signal(plugin->source, "droidcam_connect");
+            }
             continue;
         }
 
         // else: not activated
         if (plugin->audio_running) {
             plugin->audio_running = false;
+            if (plugin->audio_only)
+                droidcam_signal(plugin->source, "droidcam_disconnect");
         }
 
         LOOP:
@@ -629,12 +1692,17 @@ static void *audio_thread(void *data) {
         }
 
         if (plugin->audio_decoder) {
+            if (plugin->audio_only && !iso_continues(plugin))
+                plugin->iso.stop();
+
             dlog("release audio_decoder");
+            plugin->audio_decoder_lock.lock();
             delete plugin->audio_decoder;
             plugin->audio_decoder = NULL;
+            plugin->audio_decoder_lock.unlock();
         }
 
-        if (plugin->enable_audio) obs_source_output_audio(plugin->source, NULL);
+        if (plugin->enable_audio || plugin->audio_only) obs_source_output_audio(plugin->source, NULL);
         os_sleep_ms(MILLI_SEC / FPS);
     }
 
@@ -704,7 +1772,7 @@ static void *comms_thread(void *data) {
     {
         os_event_reset(plugin->comms_signal);
 
-        if (plugin->activated && plugin->video_running) {
+        if (plugin->activated && (plugin->video_running || plugin->audio_running)) {
 
             if (sock == INVALID_SOCKET) {
                 if ((sock = connect(plugin)) == INVALID_SOCKET)
@@ -797,6 +1865,161 @@ static void *comms_thread(void *data) {
     return NULL;
 }
 
+#define stats_printf(...) do { \
+    if (len < size) len += snprintf(&buf[len], size - len, __VA_ARGS__); \
+    } while (0)
+
+static void source_stats(droidcam_obs_source *plugin, char *buf, size_t size) {
+    size_t len = 0;
+    MediaClock *clock = &plugin->media_clock;
+    AudioJitterBuffer *jb = &plugin->audio_buffer;
+
+    buf[0] = 0;
+    stats_printf("video_running=%d audio_running=%d sync_av=%d\n",
+        plugin->video_running, plugin->audio_running, plugin->sync_av);
+
+    if (plugin->video_running) {
+        stats_printf("video: %s %s\n", VideoFormatNames[plugin->video_format][1],
+            Resolutions[plugin->stream_resolution]);
+    }
+
+    if (plugin->video_running) {
+        stats_printf("pipeline: %s latency=%.2fms backlog_skips=%llu switches=%llu fallbacks=%llu\n",
+            plugin->chunked_decode ? "chunked" : plugin->inline_decode ? "inline" : "queued",
+            plugin->video_latency_ns / 1e6, (unsigned long long) plugin->backlog_skips,
+            (unsigned long long) plugin->stream_switches, (unsigned long long) plugin->switch_fallbacks);
+    }
+
+    if (plugin->video_running) {
+        std::lock_guard<std::mutex> guard(plugin->decoder_stats_lock);
+        if (plugin->decoder_stats[0])
+            stats_printf("%s", plugin->decoder_stats);
+    }
+
+    if (plugin->video_running && plugin->worker_stream && plugin->worker.ring) {
+        DecodeWorker *worker = &plugin->worker;
+        stats_printf("worker: pid=%d decoded=%llu decode=%.2fms dropped=%llu started=%llu crashes=%llu\n",
+            worker->pid, (unsigned long long) worker->ring->decoded, worker->ring->decode_ns / 1e6,
+            (unsigned long long) worker->ring->dropped, (unsigned long long) worker->started,
+            (unsigned long long) worker->crashes);
+
+        char bypassed[128];
+        worker_bypassed(plugin, bypassed, sizeof(bypassed));
+        if (bypassed[0])
+            stats_printf("worker: not applied: %s\n", bypassed);
+    }
+
+    if (plugin->video_running && plugin->backpressure_ms > 0) {
+        stats_printf("backpressure: limit=%dms%s throttled=%.2fs events=%llu\n",
+            plugin->backpressure_ms, plugin->inline_decode ? " (inactive, inline decode)"
+                : plugin->throttled ? " (throttling)" : "",
+            plugin->throttled_ns / 1e9, (unsigned long long) plugin->throttle_events);
+    }
+
+    if (plugin->video_running && plugin->uring.active()) {
+        UringRecv *ring = &plugin->uring;
+        const double frames = plugin->video_frames ? (double) plugin->video_frames : 1;
+        stats_printf("recv: io_uring%s syscalls/frame=%.2f completions/frame=%.2f\n",
+            ring->fallback ? " (fallback)" : "", ring->syscalls / frames, ring->completions / frames);
+    }
+
+    if (plugin->video_running && (plugin->config_changes || plugin->decode_recoveries
+        || plugin->decode_recovering))
+    {
+        stats_printf("recovery: config_changes=%llu recoveries=%llu errors=%d/%d%s\n",
+            (unsigned long long) plugin->config_changes,
+            (unsigned long long) plugin->decode_recoveries,
+            plugin->decode_errors, DECODE_RETRY_BUDGET,
+            plugin->decode_recovering ? " (waiting for keyframe)" : "");
+    }
+
+    if (plugin->video_running && plugin->sync.group > 0) {
+        SyncMember *sync = &plugin->sync;
+        stats_printf("sync: group=%d members=%d target=%.1fms delay=%.1fms skew=%.1fms late=%llu dropped=%llu\n",
+            sync->group, sync_group_members(sync->group), sync->target_ns / 1e6,
+            sync->delay_ns / 1e6, sync_group_skew_ms(sync->group),
+            (unsigned long long) sync->late, (unsigned long long) plugin->sync_output.dropped);
+    }
+
+    if (plugin->video_running || plugin->audio_running) {
+        stats_printf("threads: video=%s cpus=%s audio=%s cpus=%s\n",
+            plugin->video_thread_state.sched, plugin->video_thread_state.cpus,
+            plugin->audio_thread_state.sched, plugin->audio_thread_state.cpus);
+    }
+
+    if (plugin->video_running && plugin->decode_thread && !plugin->inline_decode) {
+        static const char *priorities[] = {"hidden", "visible", "preview", "program"};
+        DecodeClient *client = &plugin->decode_client;
+        stats_printf("scheduler: workers=%d priority=%s decoded=%llu dropped=%llu\n",
+            decode_scheduler_workers(), priorities[client->priority],
+            (unsigned long long) client->decoded, (unsigned long long) client->dropped);
+    }
+
+    if (plugin->video_running && plugin->adaptive_quality) {
+        QualityController *qc = &plugin->quality;
+        stats_printf("quality: level=%s [%s..%s] fps=%.1f rate=%.1fMbps decode=%.2fms queue=%.2fms"
+            " transit=%.2fms load=%.2f drops=%llu down=%llu up=%llu\n",
+            Resolutions[qc->level], Resolutions[qc->floor], Resolutions[qc->cap],
+            qc->fps, qc->mbps, qc->decode_ms, qc->queue_ms, qc->transit_ms, qc->load,
+            (unsigned long long) qc->drops, (unsigned long long) qc->downgrades,
+            (unsigned long long) qc->upgrades);
+    }
+
+    if (plugin->iso.running) {
+        IsoRecorder *iso = &plugin->iso;
+        stats_printf("iso: written=%.1fMB queued=%.1fMB dropped=%llu\n",
+            iso->bytes_written / 1048576.0, iso->queued_bytes / 1048576.0,
+            (unsigned long long) iso->dropped);
+    }
+
+    if (plugin->replay.enabled()) {
+        ReplayBuffer *replay = &plugin->replay;
+        stats_printf("replay: %.1fs/%llus %.1fMB/%lluMB saves=%llu\n",
+            replay->duration(), (unsigned long long) (replay->max_us / 1000000),
+            replay->bytes / 1048576.0, (unsigned long long) (replay->max_bytes / 1048576),
+            (unsigned long long) replay->saves);
+    }
+
+    if (plugin->decimator.active) {
+        FrameDecimator *dec = &plugin->decimator;
+        stats_printf("decimation: %.1f -> %.2f fps ratio=%.2f\n",
+            dec->input_fps(), dec->output_fps(), dec->ratio());
+    }
+
+    if (clock->locked) {
+        stats_printf("media_clock: drift=%.1fppm jitter=%.2fms latency=%.1fms resets=%llu\n",
+            clock->drift_ppm(), clock->jitter_ms(), clock->latency_ms(),
+            (unsigned long long) clock->resets);
+    }
+
+    if (plugin->standby || plugin->standby_skipped) {
+        stats_printf("standby=%d mode=%d skipped=%llu\n", plugin->standby,
+            plugin->standby_mode, (unsigned long long) plugin->standby_skipped);
+    }
+
+    if (plugin->audio_running) {
+        stats_printf("audio_buffer: target=%dms underruns=%llu concealed=%llu trimmed=%llu resyncs=%llu\n",
+            jb->target_ms, (unsigned long long) jb->underruns, (unsigned long long) jb->concealed,
+            (unsigned long long) jb->trimmed, (unsigned long long) jb->resyncs);
+    }
+}
+
+// Every stats section at once runs well past 1KB
+static void proc_source_stats(void *data, calldata_t *cd) {
+    char buf[4096];
+    source_stats((droidcam_obs_source*)(data), buf, sizeof(buf));
+    calldata_set_string(cd, "stats", buf);
+}
+
+static void proc_save_replay(void *data, calldata_t *cd) {
+    calldata_set_bool(cd, "saved", replay_save((droidcam_obs_source*)(data)));
+}
+
+static void replay_hotkey_pressed(void *data, obs_hotkey_id, obs_hotkey_t*, bool pressed) {
+    if (pressed)
+        replay_save((droidcam_obs_source*)(data));
+}
+
 void source_destroy(void *data) {
     droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
     ilog("destroy: \"%s\"", obs_source_get_name(plugin->source));
@@ -805,25 +2028,48 @@ void source_destroy(void *data) {
         if (plugin->time_start != 0) {
             ilog("stopping");
             os_event_signal(plugin->stop_signal);
-            pthread_join(plugin->video_thread, NULL);
+            if (plugin->video_threads)
+                pthread_join(plugin->video_thread, NULL);
             pthread_join(plugin->audio_thread, NULL);
+            pthread_join(plugin->audio_decode_thread, NULL);
 
             os_event_signal(plugin->comms_signal);
             pthread_join(plugin->comms_thread, NULL);
-            pthread_join(plugin->video_decode_thread, NULL);
+            if (plugin->decode_thread)
+                decode_scheduler_remove(&plugin->decode_client);
 
             os_event_destroy(plugin->stop_signal);
             os_event_destroy(plugin->reset_signal);
             os_event_destroy(plugin->comms_signal);
+            os_event_destroy(plugin->drain_signal);
         }
 
         ilog("cleanup");
+        sync_group_leave(&plugin->sync);
+        plugin->sync_output.stop();
+        if (plugin->replay_hotkey != OBS_INVALID_HOTKEY_ID)
+            obs_hotkey_unregister(plugin->replay_hotkey);
+
+        // a save in progress finishes its file
+        plugin->replay.wait_saves();
+
         if (plugin->video_decoder) delete plugin->video_decoder;
         if (plugin->audio_decoder) delete plugin->audio_decoder;
         delete plugin;
     }
 }
 
+static bool start_video_threads(droidcam_obs_source *plugin) {
+    if (plugin->video_threads)
+        return true;
+
+    if (pthread_create(&plugin->video_thread, NULL, video_thread, plugin) != 0)
+        return false;
+
+    plugin->video_threads = true;
+    return true;
+}
+
 #if DROIDCAM_OVERRIDE
 static const char *droidcam_signals[] = {
     "void droidcam_source_status(in out int status)",
@@ -843,13 +2089,39 @@ void *source_create(obs_data_t *settings, obs_source_t *source) {
     plugin->video_running = false;
     plugin->audio_decoder = NULL;
     plugin->video_decoder = NULL;
+    plugin->worker_stream = false;
+    plugin->worker_restart = false;
+    plugin->replay_hotkey = OBS_INVALID_HOTKEY_ID;
     plugin->usb_port = 0;
     plugin->use_hw = obs_data_get_bool(settings, OPT_USE_HW_ACCEL);
+    plugin->mjpeg_backend = (int) obs_data_get_int(settings, OPT_MJPEG_BACKEND);
     plugin->video_format = (VideoFormat) obs_data_get_int(settings, OPT_VIDEO_FORMAT);
     plugin->video_resolution = obs_data_get_int(settings, OPT_RESOLUTION);
     plugin->enable_audio  = obs_data_get_bool(settings, OPT_ENABLE_AUDIO);
+    plugin->audio_only    = obs_data_get_bool(settings, OPT_AUDIO_ONLY);
+    plugin->video_threads = false;
     plugin->deactivateWNS = obs_data_get_bool(settings, OPT_DEACTIVATE_WNS);
+    plugin->standby_mode = (StandbyMode) obs_data_get_int(settings, OPT_STANDBY_MODE);
+    plugin->tally_resolution = obs_data_get_bool(settings, OPT_TALLY_RESOLUTION);
+    plugin->idle_resolution = (int) obs_data_get_int(settings, OPT_IDLE_RESOLUTION);
+    plugin->adaptive_quality = obs_data_get_bool(settings, OPT_ADAPTIVE_QUALITY);
+    plugin->quality_min = (int) obs_data_get_int(settings, OPT_QUALITY_MIN);
+    plugin->quality_max = (int) obs_data_get_int(settings, OPT_QUALITY_MAX);
     plugin->activated = obs_data_get_bool(settings, OPT_IS_ACTIVATED);
+    plugin->sync_av = obs_data_get_bool(settings, OPT_SYNC_AV);
+    plugin->subnet_scan = obs_data_get_bool(settings, OPT_SUBNET_SCAN);
+    plugin->match_canvas_fps = obs_data_get_bool(settings, OPT_MATCH_CANVAS_FPS);
+    plugin->iso_record = obs_data_get_bool(settings, OPT_ISO_RECORD);
+    plugin->hold_ms = (int) obs_data_get_int(settings, OPT_HOLD_FRAME);
+    sync_group_join(&plugin->sync, (int) obs_data_get_int(settings, OPT_SYNC_GROUP));
+    plugin->pipeline_mode = (PipelineMode) obs_data_get_int(settings, OPT_PIPELINE_MODE);
+    plugin->uring_recv = obs_data_get_bool(settings, OPT_URING_RECV);
+    plugin->decode_worker = obs_data_get_bool(settings, OPT_DECODE_WORKER);
+    plugin->backpressure_ms = (int) obs_data_get_int(settings, OPT_BACKPRESSURE);
+    plugin->replay.configure((int) obs_data_get_int(settings, OPT_REPLAY_SECONDS),
+        (int) obs_data_get_int(settings, OPT_REPLAY_MB));
+    read_thread_tuning(plugin, settings);
+    plugin->audio_buffer.base_target_ms = (int) obs_data_get_int(settings, OPT_AUDIO_BUFFER);
     obs_data_set_string(settings, "remote_url", "");
 
     #if DROIDCAM_OVERRIDE
@@ -874,8 +2146,9 @@ void *source_create(obs_data_t *settings, obs_source_t *source) {
 
     #endif
 
-    ilog("activated=%d, deactivateWNS=%d, is_showing=%d, enable_audio=%d",
-        plugin->activated, plugin->deactivateWNS, plugin->is_showing, plugin->enable_audio);
+    ilog("activated=%d, deactivateWNS=%d, is_showing=%d, enable_audio=%d, audio_only=%d",
+        plugin->activated, plugin->deactivateWNS, plugin->is_showing, plugin->enable_audio,
+        plugin->audio_only);
     ilog("video_format=%s video_resolution=%s",
         VideoFormatNames[plugin->video_format][1],
         Resolutions[plugin->video_resolution]);
@@ -887,6 +2160,12 @@ void *source_create(obs_data_t *settings, obs_source_t *source) {
         return plugin;
     }
 
+    proc_handler_t *ph = obs_source_get_proc_handler(source);
+    proc_handler_add(ph, "void droidcam_source_stats(out string stats)", proc_source_stats, plugin);
+    proc_handler_add(ph, "void droidcam_save_replay(out bool saved)", proc_save_replay, plugin);
+    plugin->replay_hotkey = obs_hotkey_register_source(source, "droidcam_save_replay",
+        TEXT_REPLAY_SAVE, replay_hotkey_pressed, plugin);
+
     if (plugin->activated) {
         plugin->device_info.id = obs_data_get_string(settings, OPT_ACTIVE_DEV_ID);
         plugin->device_info.ip = obs_data_get_string(settings, OPT_ACTIVE_DEV_IP);
@@ -928,12 +2207,13 @@ void *source_create(obs_data_t *settings, obs_source_t *source) {
         return NULL;
     }
 
-    if (pthread_create(&plugin->video_thread, NULL, video_thread, plugin) != 0) {
+    if (os_event_init(&plugin->drain_signal, OS_EVENT_TYPE_AUTO) != 0) {
         source_destroy(plugin);
         return NULL;
     }
 
-    if (pthread_create(&plugin->video_decode_thread, NULL, video_decode_thread, plugin) != 0) {
+    // audio only sources never pull video
+    if (!plugin->audio_only && !start_video_threads(plugin)) {
         source_destroy(plugin);
         return NULL;
     }
@@ -948,6 +2228,11 @@ void *source_create(obs_data_t *settings, obs_source_t *source) {
         return NULL;
     }
 
+    if (pthread_create(&plugin->audio_decode_thread, NULL, audio_decode_thread, plugin) != 0) {
+        source_destroy(plugin);
+        return NULL;
+    }
+
     plugin->time_start = os_gettime_ns() / 100;
     return plugin;
 }
@@ -955,6 +2240,8 @@ void *source_create(obs_data_t *settings, obs_source_t *source) {
 void source_show(void *data) {
     droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
     plugin->is_showing = true;
+    plugin->visible = true;
+    plugin->standby = false;
 
     plugin->tally.on_preview = true;
     comms_task(CommsTask::TALLY);
@@ -963,12 +2250,17 @@ void source_show(void *data) {
 
 void source_hide(void *data) {
     droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
-    if (plugin->deactivateWNS && plugin->activated)
-        plugin->is_showing = false;
+    plugin->visible = false;
+    if (plugin->deactivateWNS && plugin->activated) {
+        if (plugin->standby_mode != STANDBY_OFF)
+            plugin->standby = true;
+        else
+            plugin->is_showing = false;
+    }
 
     plugin->tally.on_preview = false;
     comms_task(CommsTask::TALLY);
-    dlog("source_hide: is_showing=%d", plugin->is_showing);
+    dlog("source_hide: is_showing=%d standby=%d", plugin->is_showing, plugin->standby);
 }
 
 void source_show_main(void *data) {
@@ -985,11 +2277,19 @@ void source_hide_main(void *data) {
 
 static inline void toggle_ppts(obs_properties_t *ppts, bool enable) {
     obs_property_set_enabled(obs_properties_get(ppts, OPT_REFRESH)     , enable);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_SUBNET_SCAN) , enable);
     obs_property_set_enabled(obs_properties_get(ppts, OPT_DEVICE_LIST) , enable);
     obs_property_set_enabled(obs_properties_get(ppts, OPT_WIFI_IP)     , enable);
     obs_property_set_enabled(obs_properties_get(ppts, OPT_APP_PORT)    , enable);
     obs_property_set_enabled(obs_properties_get(ppts, OPT_ENABLE_AUDIO), enable);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_AUDIO_ONLY)  , enable);
     obs_property_set_enabled(obs_properties_get(ppts, OPT_USE_HW_ACCEL), enable);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_MJPEG_BACKEND), enable);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_PIPELINE_MODE), enable);
+    #ifdef __linux__
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_URING_RECV), enable);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_DECODE_WORKER), enable);
+    #endif
 }
 
 void resolve_device_type(struct active_device_info *device_info, void* data) {
@@ -1011,6 +2311,13 @@ void resolve_device_type(struct active_device_info *device_info, void* data) {
         return;
     }
 
+    dev = plugin->scanMgr.GetDevice(id);
+    if (dev) {
+        device_info->ip = dev->address;
+        device_info->type = DeviceType::WIFI;
+        return;
+    }
+
     dev = adbMgr->GetDevice(id);
     if (dev) {
         if (adbMgr->DeviceOffline(dev)) {
@@ -1056,6 +2363,25 @@ static bool video_parms_changed(void *data, obs_properties_t*, obs_property_t*,
     return false;
 }
 
+#ifdef __linux__
+// Packet level features are not fed by the decode worker
+static bool decode_worker_changed(obs_properties_t *ppts, obs_property_t*, obs_data_t *settings) {
+    const bool worker = obs_data_get_bool(settings, OPT_DECODE_WORKER);
+    const bool activated = obs_data_get_bool(settings, OPT_IS_ACTIVATED);
+
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_ISO_RECORD)      , !worker);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_ISO_PATH)        , !worker);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_ISO_FORMAT)      , !worker);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_REPLAY_SECONDS)  , !worker);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_REPLAY_MB)       , !worker);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_REPLAY_SAVE)     , !worker);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_MATCH_CANVAS_FPS), !worker);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_BACKPRESSURE)    , !worker);
+    obs_property_set_enabled(obs_properties_get(ppts, OPT_PIPELINE_MODE)   , !worker && !activated);
+    return true;
+}
+#endif
+
 static bool connect_clicked(obs_properties_t *ppts, obs_property_t *p, void *data) {
     droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
     struct active_device_info *device_info = &plugin->device_info;
@@ -1073,6 +2399,9 @@ static bool connect_clicked(obs_properties_t *ppts, obs_property_t *p, void *dat
         plugin->activated = false;
         toggle_ppts(ppts, true);
         obs_data_set_bool(settings, OPT_IS_ACTIVATED, false);
+        #ifdef __linux__
+        decode_worker_changed(ppts, NULL, settings);
+        #endif
         obs_property_set_description(cp, TEXT_CONNECT);
         ilog("deactivate");
         goto out;
@@ -1169,6 +2498,36 @@ static bool connect_clicked(obs_properties_t *ppts, obs_property_t *p, void *dat
     return true;
 }
 
+// Subnet scan hits, less the devices mDNS found too
+static void add_scanned_devices(droidcam_obs_source *plugin, obs_property_t *list) {
+    Device* dev;
+    SubnetScan *scanMgr = &plugin->scanMgr;
+    MDNS *mdnsMgr = &plugin->mdnsMgr;
+
+    scanMgr->ResetIter();
+    while ((dev = scanMgr->NextDevice()) != NULL) {
+        Device *other;
+        bool duplicate = false;
+
+        mdnsMgr->ResetIter();
+        while ((other = mdnsMgr->NextDevice()) != NULL)
+            if (strncmp(other->address, dev->address, sizeof(Device::address)) == 0) duplicate = true;
+
+        if (duplicate)
+            continue;
+
+        dlog("SCAN: label:%s serial:%s", dev->model, dev->serial);
+        obs_property_list_add_string(list, dev->model, dev->serial);
+    }
+}
+
+static bool replay_clicked(obs_properties_t *ppts, obs_property_t *p, void *data) {
+    UNUSED_PARAMETER(ppts);
+    UNUSED_PARAMETER(p);
+    replay_save((droidcam_obs_source*)(data));
+    return false;
+}
+
 static bool refresh_clicked(obs_properties_t *ppts, obs_property_t *p, void *data) {
     droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
     Device* dev;
@@ -1189,6 +2548,16 @@ static bool refresh_clicked(obs_properties_t *ppts, obs_property_t *p, void *dat
     mdnsMgr->Reload();
     adbMgr->Reload();
     iosMgr->Reload();
+    if (plugin->subnet_scan) {
+        obs_data_t *settings = obs_source_get_settings(plugin->source);
+        plugin->scanMgr.port = (int) obs_data_get_int(settings, OPT_APP_PORT);
+        obs_data_release(settings);
+        plugin->scanMgr.Reload();
+    }
+    else {
+        plugin->scanMgr.ResetIter();
+        plugin->scanMgr.Clear();
+    }
 
     p = obs_properties_get(ppts, OPT_DEVICE_LIST);
     obs_property_list_clear(p);
@@ -1218,6 +2587,8 @@ static bool refresh_clicked(obs_properties_t *ppts, obs_property_t *p, void *dat
         obs_property_list_add_string(p, label, dev->serial);
     }
 
+    add_scanned_devices(plugin, p);
+
     obs_property_list_add_string(p, TEXT_USE_WIFI, opt_use_wifi);
     obs_property_set_enabled(cp, true);
     return true;
@@ -1226,17 +2597,42 @@ static bool refresh_clicked(obs_properties_t *ppts, obs_property_t *p, void *dat
 void source_update(void *data, obs_data_t *settings) {
     droidcam_obs_source *plugin = (droidcam_obs_source*)(data);
     plugin->deactivateWNS = obs_data_get_bool(settings, OPT_DEACTIVATE_WNS);
+    plugin->standby_mode  = (StandbyMode) obs_data_get_int(settings, OPT_STANDBY_MODE);
+    plugin->tally_resolution = obs_data_get_bool(settings, OPT_TALLY_RESOLUTION);
+    plugin->idle_resolution  = (int) obs_data_get_int(settings, OPT_IDLE_RESOLUTION);
+    plugin->adaptive_quality = obs_data_get_bool(settings, OPT_ADAPTIVE_QUALITY);
+    plugin->quality_min = (int) obs_data_get_int(settings, OPT_QUALITY_MIN);
+    plugin->quality_max = (int) obs_data_get_int(settings, OPT_QUALITY_MAX);
     plugin->enable_audio  = obs_data_get_bool(settings, OPT_ENABLE_AUDIO);
+    plugin->audio_only    = obs_data_get_bool(settings, OPT_AUDIO_ONLY);
     plugin->use_hw = obs_data_get_bool(settings, OPT_USE_HW_ACCEL);
-    bool sync_av = false; // obs_data_get_bool(settings, OPT_SYNC_AV);
+    plugin->mjpeg_backend = (int) obs_data_get_int(settings, OPT_MJPEG_BACKEND);
+    plugin->audio_buffer.base_target_ms = (int) obs_data_get_int(settings, OPT_AUDIO_BUFFER);
+    plugin->sync_av = obs_data_get_bool(settings, OPT_SYNC_AV);
+    plugin->subnet_scan = obs_data_get_bool(settings, OPT_SUBNET_SCAN);
+    plugin->match_canvas_fps = obs_data_get_bool(settings, OPT_MATCH_CANVAS_FPS);
+    plugin->iso_record = obs_data_get_bool(settings, OPT_ISO_RECORD);
+    plugin->hold_ms = (int) obs_data_get_int(settings, OPT_HOLD_FRAME);
+    sync_group_join(&plugin->sync, (int) obs_data_get_int(settings, OPT_SYNC_GROUP));
+    plugin->pipeline_mode = (PipelineMode) obs_data_get_int(settings, OPT_PIPELINE_MODE);
+    plugin->uring_recv = obs_data_get_bool(settings, OPT_URING_RECV);
+    plugin->decode_worker = obs_data_get_bool(settings, OPT_DECODE_WORKER);
+    plugin->backpressure_ms = (int) obs_data_get_int(settings, OPT_BACKPRESSURE);
+    plugin->replay.configure((int) obs_data_get_int(settings, OPT_REPLAY_SECONDS),
+        (int) obs_data_get_int(settings, OPT_REPLAY_MB));
+    read_thread_tuning(plugin, settings);
     bool activated = obs_data_get_bool(settings, OPT_IS_ACTIVATED);
 
     dlog("plugin_udpate: activated=%d (actual=%d) audio=%d sync_av=%d",
         plugin->activated,
         activated,
         plugin->enable_audio,
-        sync_av);
-    obs_source_set_async_decoupled(plugin->source, !sync_av);
+        plugin->sync_av);
+    obs_source_set_async_decoupled(plugin->source, !plugin->sync_av);
+
+    // switching out of audio only mode
+    if (!plugin->audio_only && plugin->time_start != 0 && !start_video_threads(plugin))
+        elog("error starting video threads");
 
     // handle [Cancel] case
     if (activated != plugin->activated) {
@@ -1270,6 +2666,20 @@ obs_properties_t *source_properties(void *data) {
 
     obs_property_set_modified_callback2(cp, video_parms_changed, data);
 
+    obs_properties_add_bool(ppts, OPT_TALLY_RESOLUTION, TEXT_TALLY_RESOLUTION);
+    cp = obs_properties_add_list(ppts, OPT_IDLE_RESOLUTION, TEXT_IDLE_RESOLUTION, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    for (size_t i = 0; i <= RESOLUTION_1080; i++)
+        obs_property_list_add_int(cp, Resolutions[i], i);
+
+    obs_properties_add_bool(ppts, OPT_ADAPTIVE_QUALITY, TEXT_ADAPTIVE_QUALITY);
+    cp = obs_properties_add_list(ppts, OPT_QUALITY_MIN, TEXT_QUALITY_MIN, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    for (size_t i = 0; i < ARRAY_LEN(Resolutions); i++)
+        obs_property_list_add_int(cp, Resolutions[i], i);
+
+    cp = obs_properties_add_list(ppts, OPT_QUALITY_MAX, TEXT_QUALITY_MAX, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    for (size_t i = 0; i < ARRAY_LEN(Resolutions); i++)
+        obs_property_list_add_int(cp, Resolutions[i], i);
+
     cp = obs_properties_add_list(ppts, OPT_VIDEO_FORMAT, TEXT_VIDEO_FORMAT, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
     for (size_t i = 0; i < ARRAY_LEN(VideoFormatNames); i++)
         obs_property_list_add_int(cp, VideoFormatNames[i][0], i);
@@ -1303,25 +2713,78 @@ obs_properties_t *source_properties(void *data) {
             char *label = dev->model[0] != 0 ? dev->model : dev->serial;
             obs_property_list_add_string(cp, label, dev->serial);
         }
+
+        add_scanned_devices(plugin, cp);
     }
 
     obs_property_list_add_string(cp, TEXT_USE_WIFI, opt_use_wifi);
     obs_properties_add_button(ppts, OPT_REFRESH, TEXT_REFRESH, refresh_clicked);
+    obs_properties_add_bool(ppts, OPT_SUBNET_SCAN, TEXT_SUBNET_SCAN);
     cp = obs_properties_add_button(ppts, OPT_CONNECT, TEXT_CONNECT, connect_clicked);
 
     obs_properties_add_text(ppts, OPT_WIFI_IP, "WiFi IP", OBS_TEXT_DEFAULT);
     obs_properties_add_int(ppts, OPT_APP_PORT, "DroidCam Port", 1, 65535, 1);
 
     obs_properties_add_bool(ppts, OPT_ENABLE_AUDIO, TEXT_ENABLE_AUDIO);
-    // obs_properties_add_bool(ppts, OPT_SYNC_AV, TEXT_SYNC_AV);
+    obs_properties_add_bool(ppts, OPT_AUDIO_ONLY, TEXT_AUDIO_ONLY);
+    obs_properties_add_int_slider(ppts, OPT_AUDIO_BUFFER, TEXT_AUDIO_BUFFER,
+        AUDIO_BUFFER_MIN_MS, AUDIO_BUFFER_MAX_MS, 10);
+    obs_properties_add_bool(ppts, OPT_SYNC_AV, TEXT_SYNC_AV);
     #if DROIDCAM_OVERRIDE==0
     obs_properties_add_bool(ppts, OPT_DEACTIVATE_WNS, TEXT_DWNS);
     #endif
+
+    cp = obs_properties_add_list(ppts, OPT_STANDBY_MODE, TEXT_STANDBY_MODE, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(cp, TEXT_STANDBY_OFF, STANDBY_OFF);
+    obs_property_list_add_int(cp, TEXT_STANDBY_KEYFRAMES, STANDBY_KEYFRAMES);
+    obs_property_list_add_int(cp, TEXT_STANDBY_NO_DECODE, STANDBY_NO_DECODE);
+    obs_properties_add_bool(ppts, OPT_MATCH_CANVAS_FPS, TEXT_MATCH_CANVAS_FPS);
     obs_properties_add_bool(ppts, OPT_USE_HW_ACCEL, TEXT_USE_HW_ACCEL);
+    cp = obs_properties_add_list(ppts, OPT_MJPEG_BACKEND, TEXT_MJPEG_BACKEND, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(cp, TEXT_MJPEG_AUTO, MJPEG_AUTO);
+    obs_property_list_add_int(cp, TEXT_MJPEG_TURBOJPEG, MJPEG_TURBOJPEG);
+    obs_property_list_add_int(cp, TEXT_MJPEG_LIBAVCODEC, MJPEG_LIBAVCODEC);
+
+    obs_properties_add_int_slider(ppts, OPT_HOLD_FRAME, TEXT_HOLD_FRAME, 0, 10000, 500);
+    cp = obs_properties_add_list(ppts, OPT_SYNC_GROUP, TEXT_SYNC_GROUP, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(cp, TEXT_SYNC_GROUP_NONE, 0);
+    for (int i = 1; i <= SYNC_GROUPS; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), TEXT_SYNC_GROUP_N, i);
+        obs_property_list_add_int(cp, name, i);
+    }
+    obs_properties_add_bool(ppts, OPT_ISO_RECORD, TEXT_ISO_RECORD);
+    obs_properties_add_path(ppts, OPT_ISO_PATH, TEXT_ISO_PATH, OBS_PATH_DIRECTORY, NULL, NULL);
+    cp = obs_properties_add_list(ppts, OPT_ISO_FORMAT, TEXT_ISO_FORMAT, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+    obs_property_list_add_string(cp, "MKV", "mkv");
+    obs_property_list_add_string(cp, "MP4", "mp4");
+    obs_properties_add_int_slider(ppts, OPT_REPLAY_SECONDS, TEXT_REPLAY_SECONDS, 0, 300, 5);
+    obs_properties_add_int_slider(ppts, OPT_REPLAY_MB, TEXT_REPLAY_MB, 16, 2048, 16);
+    obs_properties_add_button(ppts, OPT_REPLAY_SAVE, TEXT_REPLAY_SAVE, replay_clicked);
+
+    cp = obs_properties_add_list(ppts, OPT_PIPELINE_MODE, TEXT_PIPELINE_MODE, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(cp, TEXT_PIPELINE_QUEUED, PIPELINE_QUEUED);
+    obs_property_list_add_int(cp, TEXT_PIPELINE_INLINE, PIPELINE_INLINE);
+    obs_property_list_add_int(cp, TEXT_PIPELINE_CHUNKED, PIPELINE_CHUNKED);
+    obs_properties_add_int_slider(ppts, OPT_BACKPRESSURE, TEXT_BACKPRESSURE, 0, 1000, 10);
+    #ifdef __linux__
+    obs_properties_add_bool(ppts, OPT_URING_RECV, TEXT_URING_RECV);
+    cp = obs_properties_add_bool(ppts, OPT_DECODE_WORKER, TEXT_DECODE_WORKER);
+    obs_property_set_modified_callback(cp, decode_worker_changed);
+    #endif
+
+    cp = obs_properties_add_list(ppts, OPT_THREAD_SCHED, TEXT_THREAD_SCHED, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(cp, TEXT_THREAD_SCHED_GLOBAL, THREAD_SCHED_GLOBAL);
+    obs_property_list_add_int(cp, TEXT_THREAD_SCHED_DEFAULT, THREAD_SCHED_DEFAULT);
+    obs_property_list_add_int(cp, TEXT_THREAD_SCHED_NICE, THREAD_SCHED_NICE);
+    obs_property_list_add_int(cp, TEXT_THREAD_SCHED_RR, THREAD_SCHED_RR);
+    obs_property_list_add_int(cp, TEXT_THREAD_SCHED_FIFO, THREAD_SCHED_FIFO);
+    obs_properties_add_int_slider(ppts, OPT_THREAD_NICE, TEXT_THREAD_NICE, -20, 19, 1);
+    obs_properties_add_text(ppts, OPT_THREAD_AFFINITY, TEXT_THREAD_AFFINITY, OBS_TEXT_DEFAULT);
 
     if (activated) {
         toggle_ppts(ppts, false);
-        obs_property_set_description(cp, TEXT_DEACTIVATE);
+        obs_property_set_description(obs_properties_get(ppts, OPT_CONNECT), TEXT_DEACTIVATE);
     }
 
     return ppts;
@@ -1333,7 +2796,31 @@ void source_defaults(obs_data_t *settings) {
     obs_data_set_default_bool(settings, OPT_IS_ACTIVATED, false);
     obs_data_set_default_bool(settings, OPT_SYNC_AV, false);
     obs_data_set_default_bool(settings, OPT_USE_HW_ACCEL, true);
+    obs_data_set_default_int(settings, OPT_MJPEG_BACKEND, MJPEG_AUTO);
+    obs_data_set_default_bool(settings, OPT_MATCH_CANVAS_FPS, false);
+    obs_data_set_default_int(settings, OPT_PIPELINE_MODE, PIPELINE_QUEUED);
+    obs_data_set_default_bool(settings, OPT_URING_RECV, false);
+    obs_data_set_default_bool(settings, OPT_DECODE_WORKER, false);
+    obs_data_set_default_int(settings, OPT_BACKPRESSURE, 0);
+    obs_data_set_default_bool(settings, OPT_ISO_RECORD, false);
+    obs_data_set_default_int(settings, OPT_HOLD_FRAME, 0);
+    obs_data_set_default_int(settings, OPT_SYNC_GROUP, 0);
+    obs_data_set_default_int(settings, OPT_THREAD_SCHED, THREAD_SCHED_GLOBAL);
+    obs_data_set_default_int(settings, OPT_THREAD_NICE, -5);
+    obs_data_set_default_string(settings, OPT_THREAD_AFFINITY, "");
+    obs_data_set_default_string(settings, OPT_ISO_FORMAT, "mkv");
+    obs_data_set_default_int(settings, OPT_REPLAY_SECONDS, 0);
+    obs_data_set_default_int(settings, OPT_REPLAY_MB, 256);
     obs_data_set_default_bool(settings, OPT_ENABLE_AUDIO, false);
+    obs_data_set_default_bool(settings, OPT_AUDIO_ONLY, false);
+    obs_data_set_default_int(settings, OPT_AUDIO_BUFFER, AUDIO_BUFFER_DEFAULT_MS);
     obs_data_set_default_bool(settings, OPT_DEACTIVATE_WNS, false);
+    obs_data_set_default_int(settings, OPT_STANDBY_MODE, STANDBY_OFF);
+    obs_data_set_default_bool(settings, OPT_TALLY_RESOLUTION, false);
+    obs_data_set_default_int(settings, OPT_IDLE_RESOLUTION, 0);
+    obs_data_set_default_bool(settings, OPT_ADAPTIVE_QUALITY, false);
+    obs_data_set_default_int(settings, OPT_QUALITY_MIN, 0);
+    obs_data_set_default_int(settings, OPT_QUALITY_MAX, ARRAY_LEN(Resolutions) - 1);
     obs_data_set_default_int(settings, OPT_APP_PORT, DEFAULT_PORT);
+    obs_data_set_default_bool(settings, OPT_SUBNET_SCAN, false);
 }
@@ -36,6 +36,20 @@ enum VideoFormat {
     FORMAT_MJPG,
 };
 
+// What a hidden source does when deactivateWNS is set
+enum StandbyMode {
+    STANDBY_OFF,        // disconnect
+    STANDBY_KEYFRAMES,  // stay connected, decode keyframes only
+    STANDBY_NO_DECODE,  // stay connected, decode nothing
+};
+
+// How received video reaches the decoder
+enum PipelineMode {
+    PIPELINE_QUEUED,    // decodeQueue + video_decode_thread
+    PIPELINE_INLINE,    // decode on video_thread as soon as a frame is read
+    PIPELINE_CHUNKED,   // inline, and H.264 slices are decoded as they arrive
+};
+
 struct Tally_t {
     bool on_program = false;
     bool on_preview = false;
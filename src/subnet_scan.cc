@@ -0,0 +1,381 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+# include <ws2tcpip.h>
+#else
+# include <arpa/inet.h>
+# include <sys/socket.h>
+# include <net/if.h>
+# include <netinet/in.h>
+# include <poll.h>
+# include <ifaddrs.h>
+#endif
+
+#include "net.h"
+#include "device_discovery.h"
+#include "plugin.h"
+#include "plugin_properties.h"
+#include <util/platform.h>
+
+#define SCAN_CONCURRENCY 128
+#define SCAN_TIMEOUT_MS 250
+#define SCAN_RANGES_MAX 8
+
+extern const char* bindIP;
+
+struct ScanRange {
+    uint32_t first; // host order
+    uint32_t count;
+};
+
+// Never more than a /24 around each address: a /16 would be 65k connects
+static void add_range(ScanRange *ranges, int *nb_ranges, uint32_t addr, int prefix) {
+    if (prefix < 24 || prefix > 30) {
+        char ip[INET_ADDRSTRLEN];
+        struct in_addr in;
+        in.s_addr = htonl(addr);
+        inet_ntop(AF_INET, &in, ip, sizeof(ip));
+
+        if (prefix > 30) {
+            elog("scan: %s/%d has no hosts to scan, skipped", ip, prefix);
+            return;
+        }
+
+        ilog("scan: %s/%d limited to the /24 around it", ip, prefix);
+        prefix = 24;
+    }
+
+    const uint32_t mask = 0xffffffffu << (32 - prefix);
+    const uint32_t first = (addr & mask) + 1;
+    const uint32_t count = (~mask) - 1; // without the network and broadcast addresses
+
+    for (int i = 0; i < *nb_ranges; i++)
+        if (ranges[i].first == first) return;
+
+    if (*nb_ranges < SCAN_RANGES_MAX) {
+        ranges[*nb_ranges].first = first;
+        ranges[*nb_ranges].count = count;
+        (*nb_ranges)++;
+    }
+}
+
+static int prefix_len(uint32_t mask) {
+    int prefix = 0;
+    while (mask & 0x80000000u) {
+        prefix++;
+        mask <<= 1;
+    }
+    return prefix;
+}
+
+// The IPv4 subnets of the interface bindIP is on, or of every interface
+static int local_ranges(ScanRange *ranges) {
+    int nb_ranges = 0;
+    uint32_t bind_addr = 0;
+    struct in_addr in;
+
+    if (bindIP && bindIP[0] && inet_pton(AF_INET, bindIP, &in) == 1)
+        bind_addr = ntohl(in.s_addr);
+
+#ifdef _WIN32
+    // No netmask without the IP helper API, assume /24s
+    char host[256];
+    struct addrinfo hints, *result = NULL;
+    if (bind_addr) {
+        add_range(ranges, &nb_ranges, bind_addr, 24);
+        return nb_ranges;
+    }
+
+    if (gethostname(host, sizeof(host)) != 0)
+        return 0;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0)
+        return 0;
+
+    for (struct addrinfo *ai = result; ai; ai = ai->ai_next) {
+        uint32_t addr = ntohl(((struct sockaddr_in*) ai->ai_addr)->sin_addr.s_addr);
+        if ((addr >> 24) != 127)
+            add_range(ranges, &nb_ranges, addr, 24);
+    }
+    freeaddrinfo(result);
+#else
+    struct ifaddrs *ifaddr = NULL;
+    if (getifaddrs(&ifaddr) < 0) {
+        elog("scan: getifaddrs(): %s", strerror(errno));
+        return 0;
+    }
+
+    for (struct ifaddrs *ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || !ifa->ifa_netmask || ifa->ifa_addr->sa_family != AF_INET)
+            continue;
+
+        if (!(ifa->ifa_flags & IFF_UP) || (ifa->ifa_flags & IFF_LOOPBACK))
+            continue;
+
+        uint32_t addr = ntohl(((struct sockaddr_in*) ifa->ifa_addr)->sin_addr.s_addr);
+        uint32_t mask = ntohl(((struct sockaddr_in*) ifa->ifa_netmask)->sin_addr.s_addr);
+        if (bind_addr && addr != bind_addr)
+            continue;
+
+        add_range(ranges, &nb_ranges, addr, prefix_len(mask));
+    }
+    freeifaddrs(ifaddr);
+#endif
+
+    return nb_ranges;
+}
+
+// "a.b.c.d/n"
+static int parse_range(const char *subnet, ScanRange *ranges) {
+    char addr[64];
+    int nb_ranges = 0;
+    int prefix = 24;
+    struct in_addr in;
+
+    snprintf(addr, sizeof(addr), "%s", subnet);
+    char *slash = strchr(addr, '/');
+    if (slash) {
+        *slash = 0;
+        prefix = atoi(slash + 1);
+    }
+
+    if (inet_pton(AF_INET, addr, &in) != 1)
+        return 0;
+
+    add_range(ranges, &nb_ranges, ntohl(in.s_addr), prefix);
+    return nb_ranges;
+}
+
+enum ScanState {
+    SCAN_IDLE,
+    SCAN_CONNECTING,
+    SCAN_PINGING,
+};
+
+struct ScanSlot {
+    socket_t sock;
+    enum ScanState state;
+    uint32_t addr;
+    uint64_t deadline;
+    size_t received;
+    char reply[64];
+};
+
+static bool scan_connect(ScanSlot *slot, uint32_t addr, uint16_t port, uint64_t now) {
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    sin.sin_addr.s_addr = htonl(addr);
+
+    slot->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (slot->sock == INVALID_SOCKET)
+        return false;
+
+    set_nonblock(slot->sock, 1);
+    if (connect(slot->sock, (struct sockaddr*) &sin, sizeof(sin)) < 0) {
+        WSAErrno();
+        #ifdef _WIN32
+        if (errno != WSAEWOULDBLOCK)
+        #else
+        if (errno != EINPROGRESS)
+        #endif
+        {
+            net_close(slot->sock);
+            slot->sock = INVALID_SOCKET;
+            return false;
+        }
+    }
+
+    slot->state = SCAN_CONNECTING;
+    slot->addr = addr;
+    slot->deadline = now + SCAN_TIMEOUT_MS * 1000000ULL;
+    slot->received = 0;
+    return true;
+}
+
+static void scan_close(ScanSlot *slot) {
+    net_close(slot->sock);
+    slot->sock = INVALID_SOCKET;
+    slot->state = SCAN_IDLE;
+}
+
+SubnetScan::SubnetScan() {
+    port = DEFAULT_PORT;
+    subnet[0] = 0;
+    probed = 0;
+    found = 0;
+    elapsed_ms = 0;
+}
+
+// A verified hit, as a WiFi device keyed by its address
+void SubnetScan::AddHit(uint32_t addr) {
+    char address[INET_ADDRSTRLEN];
+    struct in_addr in;
+    in.s_addr = htonl(addr);
+    if (!inet_ntop(AF_INET, &in, address, sizeof(address)))
+        return;
+
+    Device *dev = AddDevice(address, sizeof(address));
+    if (!dev)
+        return;
+
+    snprintf(dev->address, sizeof(Device::address), "%s", address);
+    snprintf(dev->model, sizeof(Device::model), "DroidCam [%s] (%s)", suffix, address);
+    found++;
+    ilog("scan: found %s:%d", address, port);
+}
+
+void SubnetScan::DoReload(void) {
+    ScanRange ranges[SCAN_RANGES_MAX];
+    ScanSlot slots[SCAN_CONCURRENCY];
+    struct pollfd fds[SCAN_CONCURRENCY];
+    int map[SCAN_CONCURRENCY];
+    const uint64_t start = os_gettime_ns();
+
+    const int nb_ranges = subnet[0] ? parse_range(subnet, ranges) : local_ranges(ranges);
+    probed = 0;
+    found = 0;
+    if (nb_ranges == 0) {
+        elog("scan: no IPv4 subnet to scan");
+        return;
+    }
+
+    for (int i = 0; i < SCAN_CONCURRENCY; i++) {
+        slots[i].sock = INVALID_SOCKET;
+        slots[i].state = SCAN_IDLE;
+    }
+
+    int range = 0;
+    uint32_t next = 0;
+    int active = 0;
+
+    while (1) {
+        uint64_t now = os_gettime_ns();
+
+        // keep the window full
+        for (int i = 0; i < SCAN_CONCURRENCY && range < nb_ranges; i++) {
+            if (slots[i].state != SCAN_IDLE)
+                continue;
+
+            while (range < nb_ranges) {
+                uint32_t addr = ranges[range].first + next;
+                if (++next == ranges[range].count) {
+                    range++;
+                    next = 0;
+                }
+
+                probed++;
+                if (scan_connect(&slots[i], addr, (uint16_t) port, now)) {
+                    active++;
+                    break;
+                }
+            }
+        }
+
+        if (active == 0)
+            break;
+
+        int nfds = 0;
+        int wait_ms = SCAN_TIMEOUT_MS;
+        for (int i = 0; i < SCAN_CONCURRENCY; i++) {
+            if (slots[i].state == SCAN_IDLE)
+                continue;
+
+            fds[nfds].fd = slots[i].sock;
+            fds[nfds].events = slots[i].state == SCAN_CONNECTING ? POLLOUT : POLLIN;
+            fds[nfds].revents = 0;
+            map[nfds++] = i;
+
+            int left = slots[i].deadline > now ? (int) ((slots[i].deadline - now) / 1000000ULL) + 1 : 0;
+            if (left < wait_ms) wait_ms = left;
+        }
+
+        if (poll(fds, nfds, wait_ms) < 0) {
+            WSAErrno();
+            if (errno == EINTR)
+                continue;
+
+            elog("scan: poll(): %s", strerror(errno));
+            break;
+        }
+
+        now = os_gettime_ns();
+        for (int n = 0; n < nfds; n++) {
+            ScanSlot *slot = &slots[map[n]];
+
+            if (fds[n].revents == 0) {
+                if (now >= slot->deadline) {
+                    scan_close(slot);
+                    active--;
+                }
+                continue;
+            }
+
+            if (slot->state == SCAN_CONNECTING) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(slot->sock, SOL_SOCKET, SO_ERROR, (char*) &err, &len);
+
+                // something listens on the port: ask if it is the app
+                if (err == 0 && (fds[n].revents & POLLOUT)
+                    && net_send(slot->sock, PING_REQ, sizeof(PING_REQ) - 1) == sizeof(PING_REQ) - 1)
+                {
+                    slot->state = SCAN_PINGING;
+                    slot->deadline = now + SCAN_TIMEOUT_MS * 1000000ULL;
+                    continue;
+                }
+
+                scan_close(slot);
+                active--;
+                continue;
+            }
+
+            ssize_t r = net_recv(slot->sock, slot->reply + slot->received,
+                sizeof(slot->reply) - 1 - slot->received);
+            if (r > 0) {
+                slot->received += r;
+                slot->reply[slot->received] = 0;
+                if (!strstr(slot->reply, "\r\n") && slot->received < sizeof(slot->reply) - 1)
+                    continue;
+            }
+
+            // "HTTP/1.x 200 ..."
+            if (slot->received > 12 && memcmp(slot->reply, "HTTP/1.", 7) == 0
+                && memcmp(slot->reply + 8, " 200", 4) == 0)
+            {
+                AddHit(slot->addr);
+            }
+
+            scan_close(slot);
+            active--;
+        }
+    }
+
+    for (int i = 0; i < SCAN_CONCURRENCY; i++)
+        if (slots[i].state != SCAN_IDLE) scan_close(&slots[i]);
+
+    elapsed_ms = (int) ((os_gettime_ns() - start) / 1000000ULL);
+    ilog("scan: probed %d addresses on port %d in %dms, found %d", probed, port, elapsed_ms, found);
+}
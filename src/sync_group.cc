@@ -0,0 +1,253 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <vector>
+#include <util/platform.h>
+
+#include "plugin.h"
+#include "sync_group.h"
+#include "thread_tuning.h"
+
+// A member that has not output a frame for this long (hidden, or
+// disconnected) no longer holds the others back
+#define SYNC_ACTIVE_NS 2000000000ULL
+#define SYNC_MARGIN_NS (5 * 1000000.0)
+
+static std::mutex lock;
+static std::vector<SyncMember*> members;
+
+void sync_group_join(SyncMember *member, int group) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (member->group == group)
+        return;
+
+    for (size_t i = 0; i < members.size(); i++) {
+        if (members[i] == member) {
+            members.erase(members.begin() + i);
+            break;
+        }
+    }
+
+    member->group = group;
+    member->ready_ns = 0;
+    member->achieved_ns = 0;
+    member->updated_ns = 0;
+    member->target_ns = 0;
+    member->delay_ns = 0;
+    if (group > 0)
+        members.push_back(member);
+}
+
+void sync_group_leave(SyncMember *member) {
+    sync_group_join(member, 0);
+}
+
+// Other sources' threads may have updated after `now` was read
+static inline bool sync_active(SyncMember *m, uint64_t now) {
+    return m->updated_ns && (int64_t) (now - m->updated_ns) < (int64_t) SYNC_ACTIVE_NS;
+}
+
+// Called with the lock held
+static double group_target(int group, uint64_t now) {
+    double target = 0;
+    for (size_t i = 0; i < members.size(); i++) {
+        SyncMember *m = members[i];
+        if (m->group != group || !sync_active(m, now))
+            continue;
+
+        if (m->ready_ns > target)
+            target = m->ready_ns;
+    }
+
+    target += SYNC_MARGIN_NS;
+    if (target > SYNC_MAX_DELAY_MS * 1e6)
+        target = SYNC_MAX_DELAY_MS * 1e6;
+    return target;
+}
+
+uint64_t sync_group_schedule(SyncMember *member, uint64_t capture_ns, uint64_t now) {
+    const double ready = (double) now - (double) capture_ns;
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Behind the current schedule: the frame is late for the group
+    // whatever the new target comes out as
+    if (member->updated_ns && ready > group_target(member->group, now))
+        member->late++;
+
+    // Peak hold, decaying over ~10s so one late frame does not raise
+    // the group's latency for good
+    if (member->updated_ns == 0 || ready > member->ready_ns)
+        member->ready_ns = ready;
+    else
+        member->ready_ns += (ready - member->ready_ns) / 256.0;
+    member->updated_ns = now;
+
+    const double target = group_target(member->group, now);
+    double due = (double) capture_ns + target;
+    if (due < (double) now)
+        due = (double) now;
+
+    const double achieved = due - (double) capture_ns;
+    member->achieved_ns = member->achieved_ns
+        ? member->achieved_ns + (achieved - member->achieved_ns) / 16.0
+        : achieved;
+    member->delay_ns += ((due - (double) now) - member->delay_ns) / 16.0;
+    member->target_ns = target;
+    return (uint64_t) due;
+}
+
+uint64_t sync_group_delay_ns(SyncMember *member) {
+    std::lock_guard<std::mutex> guard(lock);
+    return member->delay_ns > 0 ? (uint64_t) member->delay_ns : 0;
+}
+
+double sync_group_skew_ms(int group) {
+    std::lock_guard<std::mutex> guard(lock);
+    const uint64_t now = os_gettime_ns();
+    double lo = 0, hi = 0;
+    bool first = true;
+
+    for (size_t i = 0; i < members.size(); i++) {
+        SyncMember *m = members[i];
+        if (m->group != group || !sync_active(m, now))
+            continue;
+
+        if (first || m->achieved_ns < lo) lo = m->achieved_ns;
+        if (first || m->achieved_ns > hi) hi = m->achieved_ns;
+        first = false;
+    }
+
+    return (hi - lo) / 1e6;
+}
+
+int sync_group_members(int group) {
+    std::lock_guard<std::mutex> guard(lock);
+    int count = 0;
+    for (size_t i = 0; i < members.size(); i++)
+        if (members[i]->group == group) count++;
+
+    return count;
+}
+
+static void *sync_output_thread(void *data) {
+    SyncOutput *out = (SyncOutput*)(data);
+    struct ThreadState state;
+    thread_tuning_apply("droidcam-sync", &thread_defaults, &state);
+
+    while (out->running) {
+        out->lock.lock();
+        if (out->queue.empty()) {
+            out->lock.unlock();
+            os_event_timedwait(out->signal, 100);
+            continue;
+        }
+
+        SyncSlot *slot = out->queue.front();
+        const uint64_t due = slot->due;
+        const uint64_t now = os_gettime_ns();
+        if (due <= now) {
+            // Off the queue, so push() can carry on while OBS copies it
+            out->queue.pop_front();
+            out->lock.unlock();
+
+            obs_source_output_video2(out->source, &slot->hold.frame);
+
+            out->lock.lock();
+            out->release(slot);
+            out->lock.unlock();
+            continue;
+        }
+        out->lock.unlock();
+
+        // Frames are pushed in due order, a new one never goes first
+        if (due - now > 2000000ULL)
+            os_event_timedwait(out->signal, (unsigned long) ((due - now) / 1000000ULL) - 1);
+        else
+            os_sleepto_ns(due);
+    }
+
+    return NULL;
+}
+
+bool SyncOutput::start(obs_source_t *src) {
+    if (running)
+        return true;
+
+    if (!signal && os_event_init(&signal, OS_EVENT_TYPE_AUTO) != 0) {
+        elog("sync: error creating event");
+        signal = NULL;
+        return false;
+    }
+
+    source = src;
+    running = true;
+    if (pthread_create(&thread, NULL, sync_output_thread, this) != 0) {
+        elog("sync: error creating thread");
+        running = false;
+        return false;
+    }
+
+    return true;
+}
+
+void SyncOutput::stop(void) {
+    if (!running)
+        return;
+
+    running = false;
+    os_event_signal(signal);
+    pthread_join(thread, NULL);
+
+    std::lock_guard<std::mutex> guard(lock);
+    while (!queue.empty()) {
+        release(queue.front());
+        queue.pop_front();
+    }
+}
+
+void SyncOutput::release(SyncSlot *slot) {
+    if (spare.size() < SYNC_SPARE)
+        spare.push_back(slot);
+    else
+        delete slot;
+}
+
+void SyncOutput::push(const struct obs_source_frame2 *frame, uint64_t due_ns) {
+    std::lock_guard<std::mutex> guard(lock);
+    SyncSlot *slot;
+
+    if (queue.size() >= SYNC_SLOTS) {
+        slot = queue.front();
+        queue.pop_front();
+        dropped++;
+    }
+    else if (!spare.empty()) {
+        slot = spare.back();
+        spare.pop_back();
+    }
+    else {
+        slot = new SyncSlot();
+    }
+
+    if (!slot->hold.copy(frame)) {
+        release(slot);
+        return;
+    }
+
+    slot->due = due_ns;
+    queue.push_back(slot);
+    os_event_signal(signal);
+}
@@ -0,0 +1,117 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <obs.h>
+#include <util/threading.h>
+
+#include "frame_hold.h"
+
+#define SYNC_GROUPS 4
+#define SYNC_MAX_DELAY_MS 500
+#define SYNC_MAX_FPS 60
+
+// Enough to hold the longest delay at the highest frame rate
+#define SYNC_SLOTS (SYNC_MAX_DELAY_MS * SYNC_MAX_FPS / 1000 + 2)
+
+// Output copies kept for reuse beyond those queued
+#define SYNC_SPARE 2
+
+// A source's place in a sync group.
+//
+// Each frame's capture time on the local clock is estimated from its pts
+// through the source's MediaClock (the delay floor, so network jitter is
+// not counted). A member reports how long after capture its frames are
+// ready to output; the group target is the slowest member's, and every
+// member delays its frames to capture + target. Cameras in one group
+// then show frames captured at the same moment together, at the latency
+// of the slowest. Differences in the minimum network delay, which the
+// clocks cannot see, remain.
+//
+// Audio is delayed by the same amount as the video, through its
+// timestamps, so each source stays in lip sync.
+struct SyncMember {
+    int group;              // 1..SYNC_GROUPS, 0 for none
+
+    // guarded by the group lock
+    double ready_ns;        // peak-hold of capture -> ready
+    double achieved_ns;     // smoothed capture -> output
+    uint64_t updated_ns;
+    double delay_ns;        // smoothed delay added
+
+    // stats
+    double target_ns;
+    uint64_t late;          // frames ready after the target
+
+    SyncMember(void) {
+        group = 0;
+        ready_ns = 0;
+        achieved_ns = 0;
+        updated_ns = 0;
+        target_ns = 0;
+        delay_ns = 0;
+        late = 0;
+    }
+};
+
+void sync_group_join(SyncMember *member, int group);
+void sync_group_leave(SyncMember *member);
+
+// Report a frame ready `ready_ns` after capture and get the local time
+// it should be output at
+uint64_t sync_group_schedule(SyncMember *member, uint64_t capture_ns, uint64_t now);
+
+// Delay currently added to the member's video, for its audio to follow
+uint64_t sync_group_delay_ns(SyncMember *member);
+
+// Spread of the members' capture -> output latency, ms
+double sync_group_skew_ms(int group);
+int sync_group_members(int group);
+
+struct SyncSlot {
+    FrameHold hold;
+    uint64_t due;
+};
+
+// Delay line for one source: frames are copied in, and output on a
+// separate thread when due. Copies are needed because the decoder
+// reuses its frame buffers. Only as many copies as the delay needs are
+// allocated, up to SYNC_SLOTS, and reused from a short free list.
+struct SyncOutput {
+    pthread_t thread;
+    os_event_t *signal;
+    volatile bool running;
+    obs_source_t *source;
+
+    std::mutex lock;
+    std::deque<SyncSlot*> queue;
+    std::vector<SyncSlot*> spare;
+
+    // stats
+    uint64_t dropped;
+
+    SyncOutput(void) {
+        signal = NULL;
+        running = false;
+        source = NULL;
+        dropped = 0;
+    }
+
+    ~SyncOutput(void) {
+        stop();
+        for (size_t i = 0; i < spare.size(); i++)
+            delete spare[i];
+        if (signal) os_event_destroy(signal);
+    }
+
+    bool start(obs_source_t *src);
+    void stop(void);
+
+    // Output `frame` at local time `due_ns`
+    void push(const struct obs_source_frame2 *frame, uint64_t due_ns);
+
+    // with lock held
+    void release(SyncSlot *slot);
+};
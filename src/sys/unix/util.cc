@@ -15,6 +15,154 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "plugin.h"
+#include "thread_tuning.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#if __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+// Per thread on Linux; elsewhere this is the whole process, so skip it
+static bool set_thread_nice(int nice) {
+#if __linux__
+    return setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), nice) == 0;
+#else
+    (void) nice;
+    return false;
+#endif
+}
+
+// What the thread had from the process (eg. `nice`, `taskset`), saved
+// before the first change so the default can put it back
+struct InheritedState {
+    bool saved;
+    bool changed;
+    int policy;
+    struct sched_param param;
+    int nice;
+#if __linux__
+    bool has_cpus;
+    cpu_set_t cpus;
+#endif
+};
+
+static thread_local struct InheritedState inherited;
+
+static void save_inherited(void) {
+    if (inherited.saved)
+        return;
+
+    if (pthread_getschedparam(pthread_self(), &inherited.policy, &inherited.param) != 0) {
+        inherited.policy = SCHED_OTHER;
+        inherited.param.sched_priority = 0;
+    }
+
+    inherited.nice = 0;
+#if __linux__
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid));
+    if (errno == 0)
+        inherited.nice = nice;
+
+    inherited.has_cpus = pthread_getaffinity_np(pthread_self(),
+        sizeof(inherited.cpus), &inherited.cpus) == 0;
+#endif
+    inherited.saved = true;
+}
+
+static void restore_inherited(void) {
+    if (!inherited.changed)
+        return;
+
+    pthread_setschedparam(pthread_self(), inherited.policy, &inherited.param);
+    set_thread_nice(inherited.nice);
+#if __linux__
+    if (inherited.has_cpus)
+        pthread_setaffinity_np(pthread_self(), sizeof(inherited.cpus), &inherited.cpus);
+#endif
+    inherited.changed = false;
+}
+
+void thread_tuning_apply(const char *name, const struct ThreadTuning *tuning,
+    struct ThreadState *state)
+{
+    char thread_name[16];
+    const char *denied = "";
+    struct sched_param param;
+    int policy = 0;
+
+    snprintf(thread_name, sizeof(thread_name), "%s", name);
+#if __APPLE__
+    pthread_setname_np(thread_name);
+#else
+    pthread_setname_np(pthread_self(), thread_name);
+#endif
+
+    // back to what the thread started with, settings may have been lowered
+    restore_inherited();
+    snprintf(state->sched, sizeof(state->sched), "default");
+    snprintf(state->cpus, sizeof(state->cpus), "any");
+
+    if (tuning->sched == THREAD_SCHED_DEFAULT && !tuning->affinity[0]) {
+        ilog("%s: sched=%s cpus=%s", thread_name, state->sched, state->cpus);
+        return;
+    }
+
+    save_inherited();
+    inherited.changed = true;
+
+    switch (tuning->sched) {
+    case THREAD_SCHED_RR:
+    case THREAD_SCHED_FIFO:
+        policy = tuning->sched == THREAD_SCHED_RR ? SCHED_RR : SCHED_FIFO;
+        param.sched_priority = THREAD_RT_PRIORITY;
+        if (pthread_setschedparam(pthread_self(), policy, &param) == 0) {
+            snprintf(state->sched, sizeof(state->sched), "%s:%d",
+                policy == SCHED_RR ? "rr" : "fifo", THREAD_RT_PRIORITY);
+            break;
+        }
+
+        // needs CAP_SYS_NICE or an rtprio limit
+        denied = policy == SCHED_RR ? "rr denied," : "fifo denied,";
+        /* fall through */
+    case THREAD_SCHED_NICE:
+        if (tuning->nice != 0 && set_thread_nice(tuning->nice))
+            snprintf(state->sched, sizeof(state->sched), "%snice:%d", denied, tuning->nice);
+        else
+            snprintf(state->sched, sizeof(state->sched), "%sdefault", denied);
+        break;
+    }
+
+    if (tuning->affinity[0]) {
+        uint64_t mask;
+        if (!parse_cpu_list(tuning->affinity, &mask)) {
+            elog("%s: bad CPU list \"%s\"", thread_name, tuning->affinity);
+        }
+        else {
+#if __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu = 0; cpu < 64; cpu++) {
+                if (mask & (1ULL << cpu)) CPU_SET(cpu, &set);
+            }
+
+            if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+                snprintf(state->cpus, sizeof(state->cpus), "%s", tuning->affinity);
+            else
+                snprintf(state->cpus, sizeof(state->cpus), "any (denied)");
+#else
+            snprintf(state->cpus, sizeof(state->cpus), "any (n/a)");
+#endif
+        }
+    }
+
+    ilog("%s: sched=%s cpus=%s", thread_name, state->sched, state->cpus);
+}
 
 #if __APPLE__
 #include <objc/objc.h>
@@ -1,7 +1,11 @@
 // Copyright (C) 2023 DEV47APPS, github.com/dev47apps
+#include <windows.h>
 #include <util/platform.h>
 #include <util/windows/win-version.h>
 #include "plugin.h"
+#include "thread_tuning.h"
+
+typedef HRESULT (WINAPI *SetThreadDescription_t)(HANDLE, PCWSTR);
 
 void get_os_name_version(char *out, size_t out_size) {
     uint32_t version = get_win_ver_int();
@@ -9,3 +13,84 @@ void get_os_name_version(char *out, size_t out_size) {
         snprintf(out, out_size, "win%d.%d", ((version>>8)&0xFF), (version&0xFF));
     }
 }
+
+// What the thread had from the process, saved before the first change
+// so the default can put it back
+struct InheritedState {
+    bool changed_priority;
+    int priority;
+    bool changed_affinity;
+    DWORD_PTR affinity;
+};
+
+static thread_local struct InheritedState inherited;
+
+void thread_tuning_apply(const char *name, const struct ThreadTuning *tuning,
+    struct ThreadState *state)
+{
+    HANDLE thread = GetCurrentThread();
+    wchar_t wname[16];
+
+    // Windows 10 1607+
+    static SetThreadDescription_t set_description = (SetThreadDescription_t)
+        GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription");
+    if (set_description) {
+        MultiByteToWideChar(CP_UTF8, 0, name, -1, wname, ARRAY_LEN(wname));
+        wname[ARRAY_LEN(wname) - 1] = 0;
+        set_description(thread, wname);
+    }
+
+    int priority = THREAD_PRIORITY_NORMAL;
+    switch (tuning->sched) {
+    case THREAD_SCHED_RR:
+    case THREAD_SCHED_FIFO:
+        priority = THREAD_PRIORITY_TIME_CRITICAL;
+        break;
+    case THREAD_SCHED_NICE:
+        priority = tuning->nice <= -10 ? THREAD_PRIORITY_HIGHEST
+                 : tuning->nice < 0    ? THREAD_PRIORITY_ABOVE_NORMAL
+                 : tuning->nice >= 10  ? THREAD_PRIORITY_LOWEST
+                 : tuning->nice > 0    ? THREAD_PRIORITY_BELOW_NORMAL
+                 : THREAD_PRIORITY_NORMAL;
+        break;
+    }
+
+    snprintf(state->sched, sizeof(state->sched), "default");
+    if (tuning->sched != THREAD_SCHED_DEFAULT) {
+        if (!inherited.changed_priority) {
+            inherited.priority = GetThreadPriority(thread);
+            if (inherited.priority == THREAD_PRIORITY_ERROR_RETURN)
+                inherited.priority = THREAD_PRIORITY_NORMAL;
+        }
+
+        inherited.changed_priority = true;
+        if (SetThreadPriority(thread, priority))
+            snprintf(state->sched, sizeof(state->sched), "priority:%d", priority);
+    }
+    else if (inherited.changed_priority) {
+        SetThreadPriority(thread, inherited.priority);
+        inherited.changed_priority = false;
+    }
+
+    snprintf(state->cpus, sizeof(state->cpus), "any");
+    uint64_t mask;
+    if (tuning->affinity[0] && parse_cpu_list(tuning->affinity, &mask)) {
+        DWORD_PTR previous = SetThreadAffinityMask(thread, (DWORD_PTR) mask);
+        if (previous) {
+            // the first change returns the inherited mask
+            if (!inherited.changed_affinity)
+                inherited.affinity = previous;
+            inherited.changed_affinity = true;
+            snprintf(state->cpus, sizeof(state->cpus), "%s", tuning->affinity);
+        }
+        else {
+            snprintf(state->cpus, sizeof(state->cpus), "any (denied)");
+        }
+    }
+    else if (inherited.changed_affinity) {
+        SetThreadAffinityMask(thread, inherited.affinity);
+        inherited.changed_affinity = false;
+    }
+
+    ilog("%s: sched=%s cpus=%s", name, state->sched, state->cpus);
+}
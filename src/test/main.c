@@ -1,13 +1,29 @@
 // Copyright (C) 2022 DEV47APPS, github.com/dev47apps
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 
 #include <util/threading.h>
+#include <util/platform.h>
 
 #include "net.h"
 #include "command.h"
 #include "plugin.h"
 #include "plugin_properties.h"
 #include "device_discovery.h"
+#include "media_clock.h"
+#include "decoder.h"
+#include "decode_scheduler.h"
+#include "uring_recv.h"
+#include "replay_buffer.h"
+#include "sync_group.h"
+#include "decode_worker.h"
+#include "video_stream.h"
+
+#ifdef __linux__
+#include <signal.h>
+#include <sys/resource.h>
+#endif
 
 void test_exec(void) {
     enum process_result pr;
@@ -67,6 +83,26 @@ void test_adb(void) {
     if (count == 0) {
         elog("Failed: No devices found");
     }
+    else {
+        // direct transport vs forward + connect setup time
+        adbMgr.ResetIter();
+        dev = adbMgr.NextDevice();
+
+        uint64_t start = os_gettime_ns();
+        socket_t sock = adbMgr.Connect(dev, 4747);
+        uint64_t direct = os_gettime_ns() - start;
+        if (sock != INVALID_SOCKET) net_close(sock);
+
+        start = os_gettime_ns();
+        if (adbMgr.AddForward(dev, 4748, 4747)) {
+            sock = net_connect(localhost_ip, 4748);
+            if (sock != INVALID_SOCKET) net_close(sock);
+            adbMgr.ClearForwards(dev);
+        }
+        uint64_t forward = os_gettime_ns() - start;
+
+        ilog("adb connect: direct=%.2fms forward=%.2fms", direct / 1e6, forward / 1e6);
+    }
     dlog("~test_adb");
 }
 
@@ -105,7 +141,7 @@ out:
     dlog("~test_net");
 }
 
-static void *proxy_run(void *data) {
+static void *test_proxy_run(void *data) {
     int proxy_port = *(int *) data;
     dlog("test_proxy() thread");
     test_net(localhost_ip, proxy_port);
@@ -116,18 +152,18 @@ static void *proxy_run(void *data) {
 
 void test_proxy(int proxy_port) {
     pthread_t thr0,thr1,thr2;
-    pthread_create(&thr0, NULL, proxy_run, &proxy_port);
-    pthread_create(&thr1, NULL, proxy_run, &proxy_port);
-    pthread_create(&thr2, NULL, proxy_run, &proxy_port);
+    pthread_create(&thr0, NULL, test_proxy_run, &proxy_port);
+    pthread_create(&thr1, NULL, test_proxy_run, &proxy_port);
+    pthread_create(&thr2, NULL, test_proxy_run, &proxy_port);
     pthread_join(thr0, NULL);
     pthread_join(thr1, NULL);
     pthread_join(thr2, NULL);
 
-    Sleep(1000);
+    os_sleep_ms(1000);
 
-    pthread_create(&thr0, NULL, proxy_run, &proxy_port);
-    pthread_create(&thr1, NULL, proxy_run, &proxy_port);
-    pthread_create(&thr2, NULL, proxy_run, &proxy_port);
+    pthread_create(&thr0, NULL, test_proxy_run, &proxy_port);
+    pthread_create(&thr1, NULL, test_proxy_run, &proxy_port);
+    pthread_create(&thr2, NULL, test_proxy_run, &proxy_port);
     pthread_join(thr0, NULL);
     pthread_join(thr1, NULL);
     pthread_join(thr2, NULL);
@@ -149,10 +185,11 @@ void test_ios(void) {
     if (count) {
         iosMgr.ResetIter();
         dev = iosMgr.NextDevice();
-        int sock = iosMgr.Connect(dev, 4747);
+        int port = 0;
+        int sock = iosMgr.Connect(dev, 4747, &port);
         if (sock > 0) {
-            test_net(localhost_ip, iosMgr.iproxy.port_local);
-            test_proxy(iosMgr.iproxy.port_local);
+            test_net(localhost_ip, port);
+            test_proxy(port);
             net_close(sock);
         }
         else {
@@ -165,11 +202,1083 @@ void test_ios(void) {
     dlog("~test_ios");
 }
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/select.h>
+
+// Throughput and per-chunk latency of a fake usbmuxd stream (a unix
+// socket pair) read directly, versus relayed through a 32K select()
+// loop and loopback TCP like the iOS proxy.
+#define TRANSPORT_CHUNK (64 * 1024)
+#define TRANSPORT_CHUNKS 1024
+
+struct transport_relay {
+    socket_t from;
+    socket_t to;
+};
+
+static void *transport_writer(void *data) {
+    socket_t sock = *(socket_t *) data;
+    uint8_t *buf = (uint8_t *) bzalloc(TRANSPORT_CHUNK);
+    for (int i = 0; i < TRANSPORT_CHUNKS; i++) {
+        uint64_t now = os_gettime_ns();
+        memcpy(buf, &now, sizeof(now));
+        if (net_send_all(sock, buf, TRANSPORT_CHUNK) <= 0)
+            break;
+    }
+    bfree(buf);
+    return 0;
+}
+
+static void *transport_relay_run(void *data) {
+    struct transport_relay *relay = (struct transport_relay *) data;
+    uint8_t *buf = (uint8_t *) bmalloc(32768);
+    fd_set set;
+
+    while (1) {
+        FD_ZERO(&set);
+        FD_SET(relay->from, &set);
+        if (select(relay->from + 1, &set, NULL, NULL, NULL) <= 0)
+            break;
+
+        ssize_t r = net_recv(relay->from, buf, 32768);
+        if (r <= 0 || net_send_all(relay->to, buf, r) <= 0)
+            break;
+    }
+    bfree(buf);
+    return 0;
+}
+
+static void transport_read(const char *name, socket_t sock, uint64_t start) {
+    uint8_t *buf = (uint8_t *) bmalloc(TRANSPORT_CHUNK);
+    uint64_t total = 0, max = 0, stamp;
+    int count = 0;
+
+    for (; count < TRANSPORT_CHUNKS; count++) {
+        if (net_recv_all(sock, buf, TRANSPORT_CHUNK) != TRANSPORT_CHUNK)
+            break;
+
+        memcpy(&stamp, buf, sizeof(stamp));
+        uint64_t latency = os_gettime_ns() - stamp;
+        total += latency;
+        if (latency > max) max = latency;
+    }
+
+    double secs = (os_gettime_ns() - start) / 1e9;
+    ilog("%s: %.0f MB/s, latency avg=%.3fms max=%.3fms", name,
+        (double) count * TRANSPORT_CHUNK / secs / 1e6,
+        count ? total / 1e6 / count : 0, max / 1e6);
+    bfree(buf);
+}
+
+void test_usbmux_transport(void) {
+    ilog("test_usbmux_transport()");
+    socket_t pair[2];
+    pthread_t writer, relay_thr;
+
+    // direct
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        elog("Failed: socketpair");
+        return;
+    }
+    uint64_t start = os_gettime_ns();
+    pthread_create(&writer, NULL, transport_writer, &pair[0]);
+    transport_read("direct", pair[1], start);
+    pthread_join(writer, NULL);
+    net_close(pair[0]);
+    net_close(pair[1]);
+
+    // relayed
+    socket_t listener = net_listen(localhost_ip, 0);
+    socket_t client = net_connect(localhost_ip, net_listen_port(listener));
+    struct transport_relay relay;
+    relay.to = net_accept(listener);
+    if (client == INVALID_SOCKET || relay.to == INVALID_SOCKET
+        || socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+    {
+        elog("Failed: relay setup");
+        goto out;
+    }
+
+    set_nonblock(client, 0);
+    set_nonblock(relay.to, 0);
+    relay.from = pair[1];
+    start = os_gettime_ns();
+    pthread_create(&relay_thr, NULL, transport_relay_run, &relay);
+    pthread_create(&writer, NULL, transport_writer, &pair[0]);
+    transport_read("proxy", client, start);
+    pthread_join(writer, NULL);
+    net_close(pair[0]);
+    pthread_join(relay_thr, NULL);
+    net_close(pair[1]);
+    net_close(relay.to);
+
+out:
+    if (client != INVALID_SOCKET) net_close(client);
+    net_close(listener);
+    dlog("~test_usbmux_transport");
+}
+#endif
+
+// Feed the media clock with a synthetic stream whose phone clock runs
+// `skew` off the local one, with random network delay on top.
+void test_media_clock(void) {
+    ilog("test_media_clock()");
+    const double skews[] = {0, 250e-6, -400e-6};
+
+    for (size_t s = 0; s < ARRAY_LEN(skews); s++) {
+        MediaClock clock;
+        const double floor_ns = 4e6;
+        double max_err = 0;
+        double last_margin = 0;
+        bool jumped = false;
+        srand(47);
+
+        // 10 minutes @ 30fps
+        for (int i = 0; i < 30 * 600; i++) {
+            uint64_t pts = 1000000 + (uint64_t) i * 33333;
+            double sent = 1e9 + (double) pts * 1000.0 * (1.0 + skews[s]);
+            double delay = floor_ns + (rand() % 10 == 0 ? rand() % 50 : rand() % 8) * 1e6;
+            clock.update(pts, (uint64_t) (sent + delay));
+
+            // the margin only ever slews
+            if (i > 0 && fabs(clock.margin - last_margin) > 33333e3 * MEDIA_CLOCK_SLEW + 1)
+                jumped = true;
+            last_margin = clock.margin;
+
+            // after settling, mapped time should follow the floor
+            if (i > 30 * 30) {
+                double err = fabs((double) clock.map(pts) - clock.margin - (sent + floor_ns));
+                if (err > max_err) max_err = err;
+            }
+        }
+
+        ilog("skew=%.0fppm: drift=%.1fppm jitter=%.2fms latency=%.1fms max_err=%.2fms",
+            skews[s] * 1e6, clock.drift_ppm(), clock.jitter_ms(), clock.latency_ms(), max_err / 1e6);
+
+        if (fabs(clock.drift_ppm() - skews[s] * 1e6) > 5 || max_err > 2e6) {
+            elog("Failed: clock did not converge");
+        }
+
+        if (jumped)
+            elog("Failed: latency margin jumped");
+    }
+    dlog("~test_media_clock");
+}
+
+// Packets go through a real Decoder's queues, decoding is simulated
+struct StressDecoder : Decoder {
+    void push_ready_packet(DataPacket* packet) { decodeQueue.add_item(packet); }
+    bool decode_video(struct obs_source_frame2*, DataPacket*, bool *got_output) {
+        *got_output = true;
+        return true;
+    }
+    bool decode_audio(struct obs_source_audio*, DataPacket*, bool *got_output) {
+        *got_output = false;
+        return false;
+    }
+    // every other frame is a non-reference B/P frame, a keyframe every 30
+    bool is_reference(DataPacket* packet) { return (packet->pts & 1) == 0; }
+    bool is_keyframe(DataPacket* packet) { return (packet->pts % 30) == 0; }
+};
+
+struct bench_stats {
+    uint64_t total;
+    uint64_t max;
+    int count;
+};
+
+static void bench_add(struct bench_stats *stats, uint64_t latency) {
+    stats->total += latency;
+    if (latency > stats->max) stats->max = latency;
+    stats->count++;
+}
+
+#ifndef _WIN32
+static void frame_header(uint8_t *header, uint64_t pts, uint32_t len) {
+    for (int b = 0; b < 8; b++) header[b] = (uint8_t) (pts >> (56 - b * 8));
+    for (int b = 0; b < 4; b++) header[8 + b] = (uint8_t) (len >> (24 - b * 8));
+}
+
+// Capture -> output latency of frames read with read_frame() from a
+// paced writer on a socket pair, queued on the decoder and decoded by
+// the shared decode scheduler (PIPELINE_QUEUED) versus decoded on the
+// receiving thread (PIPELINE_INLINE), following recv_video_frame.
+// In the backlog runs the writer stalls and then sends the held up
+// frames at once; inline decode must skip to the next keyframe.
+#define BENCH_FRAMES 120
+#define BENCH_FRAME_MS 16
+#define BENCH_FRAME_BYTES (24 * 1024)
+#define BENCH_BURST_AT 40
+#define BENCH_BURST 12
+#define BENCH_DECODE_NS 3000000ULL
+
+struct bench_stream {
+    socket_t sock;
+    bool burst;
+    uint64_t capture_ns[BENCH_FRAMES];
+};
+
+struct bench_run {
+    struct bench_stats stats;
+    struct bench_stream *stream;
+    int skips;
+};
+
+static void *bench_writer(void *data) {
+    struct bench_stream *stream = (struct bench_stream *) data;
+    const uint64_t slot = BENCH_FRAME_MS * 1000000ULL;
+    uint8_t header[HEADER_SIZE];
+    uint8_t *buf = (uint8_t *) bmalloc(BENCH_FRAME_BYTES);
+    memset(buf, 0x5a, BENCH_FRAME_BYTES);
+
+    const uint64_t start = os_gettime_ns() + slot;
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        stream->capture_ns[i] = start + i * slot;
+
+        uint64_t due = stream->capture_ns[i];
+        if (stream->burst && i >= BENCH_BURST_AT && i < BENCH_BURST_AT + BENCH_BURST)
+            due = start + (BENCH_BURST_AT + BENCH_BURST - 1) * slot;
+        os_sleepto_ns(due);
+
+        frame_header(header, (uint64_t) i, BENCH_FRAME_BYTES);
+        if (net_send_all(stream->sock, header, HEADER_SIZE) <= 0
+            || net_send_all(stream->sock, buf, BENCH_FRAME_BYTES) <= 0)
+            break;
+    }
+
+    bfree(buf);
+    return 0;
+}
+
+static void bench_decode(void *data, Decoder *decoder, DataPacket *packet) {
+    struct bench_run *run = (struct bench_run *) data;
+    (void) decoder;
+    uint64_t end = os_gettime_ns() + BENCH_DECODE_NS;
+    while (os_gettime_ns() < end)
+        ;
+
+    bench_add(&run->stats, os_gettime_ns() - run->stream->capture_ns[packet->pts]);
+}
+
+static void bench_pipeline(bool inline_decode, bool burst, struct bench_run *run) {
+    struct bench_stream stream = {};
+    StressDecoder decoder;
+    DecodeClient client;
+    DataPacket *packet;
+    socket_t pair[2];
+    pthread_t writer;
+    size_t avg_packet_size = 0;
+    bool wait_keyframe = false;
+    int has_config = 0;
+
+    memset(run, 0, sizeof(*run));
+    run->stream = &stream;
+
+    memset(&client, 0, sizeof(client));
+    client.priority = DECODE_PROGRAM;
+    client.decode = bench_decode;
+    client.data = run;
+    client.decoder = &decoder;
+    if (!inline_decode && !decode_scheduler_add(&client)) {
+        elog("Failed: decode_scheduler_add");
+        return;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        elog("Failed: socketpair");
+        return;
+    }
+
+    stream.sock = pair[0];
+    stream.burst = burst;
+    pthread_create(&writer, NULL, bench_writer, &stream);
+
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        packet = read_frame(&decoder, pair[1], &has_config);
+        if (!packet) {
+            elog("Failed: read_frame at frame %d", i);
+            break;
+        }
+        packet->recv_ns = os_gettime_ns();
+
+        if (inline_decode && video_backlog(&avg_packet_size, packet->used,
+            net_recv_pending(pair[1])))
+        {
+            run->skips++;
+            wait_keyframe = true;
+            decoder.push_empty_packet(packet);
+            continue;
+        }
+
+        if (wait_keyframe) {
+            if (!decoder.is_keyframe(packet)) {
+                decoder.push_empty_packet(packet);
+                continue;
+            }
+            wait_keyframe = false;
+        }
+
+        if (inline_decode) {
+            bench_decode(run, &decoder, packet);
+            decoder.push_empty_packet(packet);
+            continue;
+        }
+
+        decoder.push_ready_packet(packet);
+        decode_scheduler_signal();
+    }
+
+    if (!inline_decode) {
+        while (decoder.decodeQueue.size())
+            os_sleep_ms(BENCH_FRAME_MS);
+        decode_scheduler_set_decoder(&client, NULL);
+        decode_scheduler_remove(&client);
+
+        if (client.dropped)
+            elog("Failed: queued dropped %llu frames", (unsigned long long) client.dropped);
+    }
+
+    pthread_join(writer, NULL);
+    net_close(pair[0]);
+    net_close(pair[1]);
+}
+
+void test_pipeline_latency(void) {
+    ilog("test_pipeline_latency()");
+    const char *names[] = {"queued", "inline", "queued+backlog", "inline+backlog"};
+    struct bench_run runs[4];
+
+    for (int i = 0; i < 4; i++) {
+        const bool inline_decode = (i & 1) != 0;
+        const bool burst = i >= 2;
+        struct bench_run *run = &runs[i];
+        bench_pipeline(inline_decode, burst, run);
+
+        // only inline decode skips, and only on a backlog
+        if (inline_decode && burst ? run->skips == 0 : run->skips != 0)
+            elog("Failed: %s skipped %d times", names[i], run->skips);
+
+        if (!(inline_decode && burst) && run->stats.count != BENCH_FRAMES)
+            elog("Failed: %s decoded %d/%d frames", names[i], run->stats.count, BENCH_FRAMES);
+
+        if (run->stats.count)
+            ilog("%s: decoded=%d skips=%d avg=%.2fms max=%.2fms", names[i],
+                run->stats.count, run->skips, run->stats.total / 1e6 / run->stats.count,
+                run->stats.max / 1e6);
+    }
+
+    // skipping the backlog must leave inline decode caught up by the end
+    if (runs[3].stats.count && runs[2].stats.count
+        && runs[3].stats.total / runs[3].stats.count > runs[2].stats.total / runs[2].stats.count)
+        elog("Failed: inline decode did not catch up after the backlog");
+
+    dlog("~test_pipeline_latency");
+}
+#endif
+
+#ifndef _WIN32
+// Receive -> output latency of multi-slice frames read with read_frame(),
+// decoded once the whole frame is in versus each NAL as soon as it has
+// arrived (ChunkFeed). The phone's side is a paced writer on a socket
+// pair, decode cost is simulated per slice.
+#define CHUNK_FRAMES 5
+#define CHUNK_FRAME_BYTES (400 * 1024)
+#define CHUNK_SLICES 8
+#define CHUNK_SLICE_DECODE_NS 1500000ULL
+
+static const uint8_t chunk_config[] = {0, 0, 1, 0x67, 0x42, 0, 0, 1, 0x68, 0xce};
+
+struct chunk_stream {
+    socket_t sock;
+    int mbps;
+    uint64_t start_ns[CHUNK_FRAMES];
+};
+
+struct chunk_check {
+    ChunkFeed feed;
+    struct bench_stats *stats;
+    uint8_t *next;      // where the next chunk must start
+    size_t bytes;
+    int nals;
+    int chunks;
+    bool bad;
+    uint64_t done_ns;
+};
+
+static void *chunk_writer(void *data) {
+    struct chunk_stream *stream = (struct chunk_stream *) data;
+    const size_t slice = CHUNK_FRAME_BYTES / CHUNK_SLICES;
+    const uint64_t slice_ns = (uint64_t) slice * 8 * 1000 / stream->mbps;
+    uint8_t header[HEADER_SIZE];
+    uint8_t *buf = (uint8_t *) bmalloc(slice);
+
+    memset(buf, 0x5a, slice);
+    buf[0] = 0; buf[1] = 0; buf[2] = 1; buf[3] = 0x65;
+
+    frame_header(header, NO_PTS, sizeof(chunk_config));
+    net_send_all(stream->sock, header, HEADER_SIZE);
+    net_send_all(stream->sock, chunk_config, sizeof(chunk_config));
+
+    for (int i = 0; i < CHUNK_FRAMES; i++) {
+        os_sleep_ms(50);
+        uint64_t start = os_gettime_ns();
+        stream->start_ns[i] = start;
+
+        frame_header(header, (uint64_t) i * 33333, CHUNK_FRAME_BYTES);
+        net_send_all(stream->sock, header, HEADER_SIZE);
+        for (int s = 0; s < CHUNK_SLICES; s++) {
+            os_sleepto_ns(start + (s + 1) * slice_ns);
+            if (net_send_all(stream->sock, buf, slice) <= 0)
+                goto out;
+        }
+    }
+
+out:
+    bfree(buf);
+    return 0;
+}
+
+static int chunk_decode_nals(uint8_t *data, size_t size) {
+    int nals = 0;
+    for (size_t i = 0; i + 2 < size; i++)
+        if (data[i] == 0 && data[i+1] == 0 && data[i+2] == 1)
+            nals++;
+
+    uint64_t end = os_gettime_ns() + nals * CHUNK_SLICE_DECODE_NS;
+    while (os_gettime_ns() < end)
+        ;
+    return nals;
+}
+
+static void chunk_feed_decode(ChunkFeed *feed, uint8_t *data, size_t size) {
+    struct chunk_check *check = (struct chunk_check *) feed;
+    if (size == 0)
+        return;
+
+    // whole NALs only, in order, each byte once
+    if ((check->next && data != check->next) || size < 3 || data[0] || data[1] || data[2] != 1)
+        check->bad = true;
+
+    check->next = data + size;
+    check->bytes += size;
+    check->chunks++;
+    check->nals += chunk_decode_nals(data, size);
+    check->done_ns = os_gettime_ns();
+}
+
+static void chunked_run(StressDecoder *decoder, int mbps, bool chunked, struct bench_stats *stats,
+    int *chunks)
+{
+    struct chunk_stream stream = {};
+    struct chunk_check check;
+    socket_t pair[2];
+    pthread_t writer;
+    DataPacket *packet;
+    int has_config = 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        elog("Failed: socketpair");
+        return;
+    }
+
+    stream.sock = pair[0];
+    stream.mbps = mbps;
+    pthread_create(&writer, NULL, chunk_writer, &stream);
+
+    for (int i = 0; i < CHUNK_FRAMES; i++) {
+        memset(&check, 0, sizeof(check));
+        check.feed.decode = chunk_feed_decode;
+        check.feed.decoder = decoder;
+
+        packet = read_frame(decoder, pair[1], &has_config, chunked ? &check.feed : NULL);
+        if (!packet) {
+            elog("Failed: read_frame at frame %d", i);
+            break;
+        }
+
+        const int want = CHUNK_SLICES + (i == 0 ? 2 : 0);
+        if (!chunked) {
+            check.nals = chunk_decode_nals(packet->data, packet->used);
+            check.bytes = packet->used;
+            check.done_ns = os_gettime_ns();
+        }
+        else if (check.bad || check.next != packet->data + packet->used) {
+            elog("Failed: %d Mbps frame %d was not fed as whole NALs", mbps, i);
+        }
+
+        if (check.nals != want || check.bytes != packet->used)
+            elog("Failed: %d Mbps frame %d decoded %d/%d NALs, %zu/%zu bytes", mbps, i,
+                check.nals, want, check.bytes, packet->used);
+
+        bench_add(stats, check.done_ns - stream.start_ns[i]);
+        *chunks += check.chunks;
+        decoder->push_empty_packet(packet);
+    }
+
+    pthread_join(writer, NULL);
+    net_close(pair[0]);
+    net_close(pair[1]);
+}
+
+void test_chunked_latency(void) {
+    ilog("test_chunked_latency()");
+    const int mbps[] = {25, 100, 300};
+    StressDecoder decoder;
+
+    for (size_t i = 0; i < ARRAY_LEN(mbps); i++) {
+        struct bench_stats whole = {}, chunked = {};
+        int chunks = 0, whole_chunks = 0;
+
+        chunked_run(&decoder, mbps[i], false, &whole, &whole_chunks);
+        chunked_run(&decoder, mbps[i], true, &chunked, &chunks);
+        if (!whole.count || !chunked.count)
+            continue;
+
+        ilog("%3d Mbps: whole=%.2fms chunked=%.2fms saved=%.2fms chunks/frame=%.1f",
+            mbps[i], whole.total / 1e6 / whole.count, chunked.total / 1e6 / chunked.count,
+            (whole.total / 1e6 / whole.count) - (chunked.total / 1e6 / chunked.count),
+            (double) chunks / chunked.count);
+    }
+    dlog("~test_chunked_latency");
+}
+#endif
+
+// Many-source stress: 4 sources per decode worker at 30fps with a 10ms
+// simulated decode, about 20% more work than the pool can do. Reports
+// latency and drops per tally priority, program must never drop and a
+// higher priority must not drop more than a lower one.
+#define STRESS_FPS 30
+#define STRESS_DECODE_NS 10000000ULL
+#define STRESS_SECONDS 5
+
+struct stress_source {
+    DecodeClient client;
+    Decoder *decoder;
+    struct bench_stats stats;
+    uint64_t sent;
+};
+
+static void stress_decode(void *data, Decoder *decoder, DataPacket *packet) {
+    struct stress_source *source = (struct stress_source *) data;
+    (void) decoder;
+    uint64_t end = os_gettime_ns() + STRESS_DECODE_NS;
+    while (os_gettime_ns() < end)
+        ;
+
+    bench_add(&source->stats, os_gettime_ns() - packet->recv_ns);
+}
+
+void test_decode_scheduler(void) {
+    ilog("test_decode_scheduler()");
+    const char *names[] = {"hidden", "visible", "preview", "program"};
+    struct stress_source sources[DECODE_WORKERS_MAX * 4];
+    double drop_rate[DECODE_PROGRAM + 1];
+    int count;
+
+    memset(sources, 0, sizeof(sources));
+    sources[0].client.priority = DECODE_PROGRAM;
+    sources[0].decoder = new StressDecoder();
+    sources[0].client.decode = stress_decode;
+    sources[0].client.data = &sources[0];
+    sources[0].client.decoder = sources[0].decoder;
+    decode_scheduler_add(&sources[0].client);
+
+    count = decode_scheduler_workers() * 4;
+    for (int i = 1; i < count; i++) {
+        struct stress_source *src = &sources[i];
+        src->client.priority = (i == 1) ? DECODE_PREVIEW : (i % 2) ? DECODE_VISIBLE : DECODE_HIDDEN;
+        src->decoder = new StressDecoder();
+        src->client.decode = stress_decode;
+        src->client.data = src;
+        src->client.decoder = src->decoder;
+        decode_scheduler_add(&src->client);
+    }
+
+    for (int frame = 0; frame < STRESS_FPS * STRESS_SECONDS; frame++) {
+        for (int i = 0; i < count; i++) {
+            Decoder *decoder = sources[i].decoder;
+            DataPacket *packet = decoder->pull_empty_packet(64);
+            packet->pts = frame;
+            packet->recv_ns = os_gettime_ns();
+            decoder->push_ready_packet(packet);
+            sources[i].sent++;
+        }
+        decode_scheduler_signal();
+        os_sleep_ms(1000 / STRESS_FPS);
+    }
+
+    // as a source does when its decoder goes away mid stream
+    for (int i = 0; i < count; i++) {
+        decode_scheduler_set_decoder(&sources[i].client, NULL);
+        decode_scheduler_remove(&sources[i].client);
+    }
+
+    for (int p = DECODE_PROGRAM; p >= DECODE_HIDDEN; p--) {
+        struct bench_stats stats = {};
+        uint64_t sent = 0, dropped = 0;
+        drop_rate[p] = -1;
+        for (int i = 0; i < count; i++) {
+            if (sources[i].client.priority != p) continue;
+            stats.total += sources[i].stats.total;
+            stats.count += sources[i].stats.count;
+            if (sources[i].stats.max > stats.max) stats.max = sources[i].stats.max;
+            sent += sources[i].sent;
+            dropped += sources[i].client.dropped;
+        }
+        if (sent == 0) continue;
+        drop_rate[p] = (double) dropped / sent;
+
+        ilog("%s: decoded=%d/%llu dropped=%llu latency avg=%.1fms max=%.1fms", names[p],
+            stats.count, (unsigned long long) sent, (unsigned long long) dropped,
+            stats.count ? stats.total / 1e6 / stats.count : 0, stats.max / 1e6);
+    }
+
+    if (drop_rate[DECODE_PROGRAM] != 0)
+        elog("Failed: program dropped %.1f%% of its frames", drop_rate[DECODE_PROGRAM] * 100);
+
+    for (int p = DECODE_PROGRAM; p > DECODE_HIDDEN; p--) {
+        for (int lower = p - 1; lower >= DECODE_HIDDEN; lower--) {
+            if (drop_rate[p] < 0 || drop_rate[lower] < 0)
+                continue;
+            if (drop_rate[p] > drop_rate[lower])
+                elog("Failed: %s dropped %.1f%%, more than %s at %.1f%%", names[p],
+                    drop_rate[p] * 100, names[lower], drop_rate[lower] * 100);
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+        delete sources[i].decoder;
+
+    decode_scheduler_shutdown();
+    dlog("~test_decode_scheduler");
+}
+
+#ifdef __linux__
+// Video ingest with a blocking recv per header and payload versus the
+// io_uring receiver: syscalls, reader CPU time and context switches
+// per frame for a stream of framed packets over a socketpair.
+#define RECV_FRAMES 3000
+#define RECV_FRAME_SIZE (48 * 1024)
+
+static void *recv_frame_writer(void *data) {
+    socket_t sock = *(socket_t *) data;
+    uint8_t *buf = (uint8_t *) bmalloc(HEADER_SIZE + RECV_FRAME_SIZE);
+    memset(buf, 0x5a, HEADER_SIZE + RECV_FRAME_SIZE);
+
+    for (int i = 0; i < RECV_FRAMES; i++) {
+        uint64_t pts = (uint64_t) i * 33333;
+        for (int b = 0; b < 8; b++) buf[b] = (uint8_t) (pts >> (56 - b * 8));
+        buf[8] = 0;
+        buf[9] = (uint8_t) (RECV_FRAME_SIZE >> 16);
+        buf[10] = (uint8_t) (RECV_FRAME_SIZE >> 8);
+        buf[11] = (uint8_t) RECV_FRAME_SIZE;
+        if (net_send_all(sock, buf, HEADER_SIZE + RECV_FRAME_SIZE) <= 0)
+            break;
+    }
+    bfree(buf);
+    return 0;
+}
+
+static void recv_backend_run(const char *name, bool use_uring) {
+    socket_t pair[2];
+    pthread_t writer;
+    struct rusage before, after;
+    UringRecv ring;
+    uint8_t header[HEADER_SIZE];
+    uint8_t *payload = (uint8_t *) bmalloc(RECV_FRAME_SIZE);
+    uint64_t syscalls = 0;
+    int frames = 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        elog("Failed: socketpair");
+        bfree(payload);
+        return;
+    }
+
+    if (use_uring && !ring.init(pair[1])) {
+        ilog("%s: io_uring not available, skipped", name);
+        goto out;
+    }
+
+    getrusage(RUSAGE_THREAD, &before);
+    pthread_create(&writer, NULL, recv_frame_writer, &pair[0]);
+    for (; frames < RECV_FRAMES; frames++) {
+        ssize_t r = use_uring
+            ? ring.recv_all(header, HEADER_SIZE)
+            : net_recv_all(pair[1], header, HEADER_SIZE);
+        if (r != HEADER_SIZE)
+            break;
+
+        size_t len = ((size_t) header[9] << 16) | ((size_t) header[10] << 8) | header[11];
+        r = use_uring
+            ? ring.recv_all(payload, len)
+            : net_recv_all(pair[1], payload, len);
+        if (r != (ssize_t) len)
+            break;
+
+        if (!use_uring) syscalls += 2;
+    }
+    getrusage(RUSAGE_THREAD, &after);
+    pthread_join(writer, NULL);
+
+    if (use_uring) syscalls = ring.syscalls;
+    if (frames != RECV_FRAMES) {
+        elog("Failed: %s read %d/%d frames", name, frames, RECV_FRAMES);
+    }
+    else {
+        double cpu_us = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) * 1e6
+            + (after.ru_utime.tv_usec - before.ru_utime.tv_usec)
+            + (after.ru_stime.tv_sec - before.ru_stime.tv_sec) * 1e6
+            + (after.ru_stime.tv_usec - before.ru_stime.tv_usec);
+        ilog("%s: syscalls/frame=%.2f cpu/frame=%.1fus ctx_switches/frame=%.2f",
+            name, (double) syscalls / frames, cpu_us / frames,
+            (double) ((after.ru_nvcsw + after.ru_nivcsw) - (before.ru_nvcsw + before.ru_nivcsw)) / frames);
+    }
+
+out:
+    ring.close();
+    net_close(pair[0]);
+    net_close(pair[1]);
+    bfree(payload);
+}
+
+void test_recv_backend(void) {
+    ilog("test_recv_backend()");
+    recv_backend_run("blocking", false);
+    recv_backend_run("io_uring", true);
+    dlog("~test_recv_backend");
+}
+#endif
+
+// The replay buffer must start on a keyframe and stay within its limits:
+// 30fps video with a keyframe every 2s and AAC audio, for 2 minutes.
+void test_replay_buffer(void) {
+    ilog("test_replay_buffer()");
+    const int seconds[] = {10, 60};
+    const int megabytes[] = {64, 4};
+    uint8_t frame[64 * 1024];
+    memset(frame, 0, sizeof(frame));
+
+    for (size_t t = 0; t < ARRAY_LEN(seconds); t++) {
+        ReplayBuffer replay;
+        replay.configure(seconds[t], megabytes[t]);
+        replay.start(AV_CODEC_ID_H264, 1920, 1080);
+
+        // a frame arrives mid GOP first
+        for (int i = 15; i < 30 * 120; i++) {
+            uint64_t pts = (uint64_t) i * 33333;
+            bool key = (i % 60) == 0;
+            replay.write(frame, key ? 60000 : 8000, pts, true, key);
+            if (i % 2 == 0)
+                replay.write(frame, 400, pts + 1000, false, true);
+
+            std::lock_guard<std::mutex> guard(replay.lock);
+            if (replay.packets.empty())
+                continue;
+
+            if (!replay.packets.front().video || !replay.packets.front().keyframe)
+                elog("Failed: buffer does not start on a keyframe");
+
+            if (replay.bytes > replay.max_bytes)
+                elog("Failed: over the memory limit");
+
+            if (replay.last_video_pts - replay.packets.front().pts > replay.max_us)
+                elog("Failed: over the time limit");
+        }
+
+        ilog("limit %ds %dMB: buffered %.1fs %.1fMB in %d packets", seconds[t], megabytes[t],
+            replay.duration(), replay.bytes / 1048576.0, (int) replay.packets.size());
+    }
+
+    // A reconnect at the same size carries on in the buffer, with the
+    // phone's timestamps starting over; a new size starts it over
+    ReplayBuffer replay;
+    replay.configure(60, 64);
+    for (int c = 0; c < 3; c++) {
+        replay.start(AV_CODEC_ID_H264, 1920, c < 2 ? 1080 : 720);
+        for (int i = 10; i < 30 * 10; i++)
+            replay.write(frame, 8000, (uint64_t) i * 33333, true, (i % 60) == 0);
+
+        double expect = (c == 1 ? 2 * 239 * 33333 + REPLAY_JOIN_GAP_US : 239 * 33333) / 1e6;
+        ilog("stream %d: buffered %.2fs", c, replay.duration());
+        if (fabs(replay.duration() - expect) > 0.001)
+            elog("Failed: expected %.2fs buffered", expect);
+
+        std::lock_guard<std::mutex> guard(replay.lock);
+        for (size_t i = 1; i < replay.packets.size(); i++)
+            if (replay.packets[i].pts <= replay.packets[i - 1].pts) {
+                elog("Failed: timestamps going back across the reconnect");
+                break;
+            }
+    }
+    dlog("~test_replay_buffer");
+}
+
+// Three phones with their own clocks and different decode delays in one
+// sync group: frames captured together should be scheduled together,
+// with few arriving too late for the group's latency.
+void test_sync_group(void) {
+    ilog("test_sync_group()");
+    const double skews[] = {0, 200e-6, -300e-6};
+    const double decode_ns[] = {8e6, 35e6, 80e6};
+    const int cameras = (int) ARRAY_LEN(skews);
+    MediaClock clocks[ARRAY_LEN(skews)];
+    SyncMember members[ARRAY_LEN(skews)];
+    double total_skew = 0;
+    uint64_t late = 0;
+    int frames = 0;
+    srand(47);
+
+    for (int c = 0; c < cameras; c++)
+        sync_group_join(&members[c], 1);
+
+    const uint64_t start = os_gettime_ns();
+
+    // 2 minutes @ 30fps, all phones capturing at the same moments
+    for (int i = 0; i < 30 * 120; i++) {
+        const double capture = (double) start + (double) i * 33333333.0;
+        double due[ARRAY_LEN(skews)];
+
+        for (int c = 0; c < cameras; c++) {
+            uint64_t pts = 5000000 * (uint64_t) (c + 1) + (uint64_t) (i * 33333.0 * (1.0 - skews[c]));
+            double arrival = capture + 4e6 + (rand() % 10 == 0 ? rand() % 30 : rand() % 6) * 1e6;
+            double ready = arrival + decode_ns[c] + (rand() % 4) * 1e6;
+            clocks[c].update(pts, (uint64_t) arrival);
+
+            uint64_t base = clocks[c].floor_time(pts);
+            due[c] = base ? (double) sync_group_schedule(&members[c], base, (uint64_t) ready) : 0;
+        }
+
+        if (i < 30 * 10)
+            continue;
+
+        double lo = due[0], hi = due[0];
+        for (int c = 1; c < cameras; c++) {
+            if (due[c] < lo) lo = due[c];
+            if (due[c] > hi) hi = due[c];
+        }
+        total_skew += hi - lo;
+        frames++;
+    }
+
+    // the fastest camera's audio waits for the slowest as well
+    if (sync_group_delay_ns(&members[0]) < 50000000ULL)
+        elog("Failed: audio not delayed with the video");
+
+    for (int c = 0; c < cameras; c++) {
+        ilog("camera %d: decode=%.0fms target=%.1fms delay=%.1fms late=%llu", c,
+            decode_ns[c] / 1e6, members[c].target_ns / 1e6, members[c].delay_ns / 1e6,
+            (unsigned long long) members[c].late);
+        late += members[c].late;
+        sync_group_leave(&members[c]);
+    }
+
+    // late frames go out as soon as they are ready, which is a skew the
+    // group can only count
+    ilog("mean skew between cameras %.2fms, %.2f%% of frames late",
+        total_skew / frames / 1e6, late * 100.0 / (frames * cameras));
+    if (total_skew / frames > 2e6 || late * 100 > (uint64_t) frames * cameras)
+        elog("Failed: cameras out of sync");
+
+    dlog("~test_sync_group");
+}
+
+// Fake DroidCam apps on loopback addresses: two real ones, a web server
+// answering 404 and something that accepts but never replies.
+#define SCAN_TEST_PORT 14747
+
+struct fake_app {
+    const char *ip;
+    const char *reply;
+    volatile bool stop;
+    pthread_t thread;
+};
+
+static void *fake_app_run(void *data) {
+    struct fake_app *app = (struct fake_app *) data;
+    socket_t server = net_listen(app->ip, SCAN_TEST_PORT);
+    socket_t client = INVALID_SOCKET;
+    char buf[64];
+    fd_set set;
+
+    while (server != INVALID_SOCKET && !app->stop) {
+        struct timeval tv = {0, 20000};
+        FD_ZERO(&set);
+        FD_SET(server, &set);
+        if (select(server + 1, &set, NULL, NULL, &tv) <= 0)
+            continue;
+
+        if (client != INVALID_SOCKET) net_close(client);
+        client = net_accept(server);
+        if (client == INVALID_SOCKET)
+            continue;
+
+        set_nonblock(client, 0);
+        set_recv_timeout(client, 1);
+        if (net_recv(client, buf, sizeof(buf)) > 0 && app->reply)
+            net_send_all(client, app->reply, strlen(app->reply));
+    }
+
+    if (client != INVALID_SOCKET) net_close(client);
+    if (server != INVALID_SOCKET) net_close(server);
+    return 0;
+}
+
+void test_subnet_scan(void) {
+    ilog("test_subnet_scan()");
+    struct fake_app apps[] = {
+        {"127.0.0.10",  "HTTP/1.1 200 OK\r\n\r\n", false, 0},
+        {"127.0.0.77",  "HTTP/1.1 200 OK\r\n\r\n", false, 0},
+        {"127.0.0.150", "HTTP/1.1 404 Not Found\r\n\r\n", false, 0},
+        {"127.0.0.200", NULL, false, 0},
+    };
+
+    for (size_t i = 0; i < ARRAY_LEN(apps); i++)
+        pthread_create(&apps[i].thread, NULL, fake_app_run, &apps[i]);
+    os_sleep_ms(100);
+
+    SubnetScan scanMgr;
+    scanMgr.port = SCAN_TEST_PORT;
+    snprintf(scanMgr.subnet, sizeof(scanMgr.subnet), "127.0.0.0/24");
+    scanMgr.Reload();
+    scanMgr.ResetIter();
+
+    Device *dev;
+    while ((dev = scanMgr.NextDevice()) != NULL)
+        ilog("found %s: %s", dev->serial, dev->model);
+
+    ilog("probed %d in %dms, found %d", scanMgr.probed, scanMgr.elapsed_ms, scanMgr.found);
+    if (scanMgr.found != 2 || !scanMgr.GetDevice("127.0.0.10") || !scanMgr.GetDevice("127.0.0.77"))
+        elog("Failed: wrong devices found");
+
+    if (scanMgr.elapsed_ms > 1000)
+        elog("Failed: scan too slow");
+
+    for (size_t i = 0; i < ARRAY_LEN(apps); i++) {
+        apps[i].stop = true;
+        pthread_join(apps[i].thread, NULL);
+    }
+    dlog("~test_subnet_scan");
+}
+
+#ifdef __linux__
+// A forked stand-in for the worker publishes 1080p frames into the ring
+// and crashes part way: frames must arrive in order and intact, the
+// last one output must survive the crash, and the crash must be seen as
+// one to restart from.
+#define WORKER_TEST_FRAMES 300
+#define WORKER_TEST_CRASH 240
+
+void test_decode_worker(void) {
+    ilog("test_decode_worker()");
+    const uint32_t width = 1920, height = 1080;
+    const size_t y_size = width * height;
+    DecodeWorker worker;
+    struct obs_source_frame2 frame;
+    uint64_t pts, recv_ns;
+    uint64_t latency_total = 0, latency_max = 0;
+    int received = 0;
+    int64_t last = -1;
+
+    if (!worker.map_ring()) {
+        elog("Failed: no frame ring");
+        return;
+    }
+    shm_ring_reset(worker.ring);
+
+    int pid = (int) fork();
+    if (pid == 0) {
+        ShmRing *ring = worker.ring;
+        memset(&frame, 0, sizeof(frame));
+        frame.format = VIDEO_FORMAT_I420;
+        frame.width = width;
+        frame.height = height;
+        frame.linesize[0] = width;
+        frame.linesize[1] = frame.linesize[2] = width / 2;
+
+        for (int i = 0; i < WORKER_TEST_FRAMES; i++) {
+            if (i == WORKER_TEST_CRASH)
+                raise(SIGSEGV);
+
+            ShmSlot *slot = shm_ring_acquire(ring);
+            if (!slot) {
+                ring->dropped++;
+                continue;
+            }
+
+            uint8_t *base = shm_slot_data(ring, ring->write_seq);
+            memset(base, i & 0xff, y_size * 3 / 2);
+            slot->frame = frame;
+            slot->frame.data[0] = slot->frame.data[1] = slot->frame.data[2] = base;
+            slot->offset[0] = 0;
+            slot->offset[1] = (uint32_t) y_size;
+            slot->offset[2] = (uint32_t) (y_size + y_size / 4);
+            slot->pts = (uint64_t) i;
+            slot->recv_ns = os_gettime_ns();
+            shm_ring_publish(ring);
+            os_sleep_ms(4);
+        }
+        _exit(0);
+    }
+    worker.pid = pid;
+
+    while (1) {
+        if (!worker.next_frame(&frame, &pts, &recv_ns, 100)) {
+            if (!worker.alive()) break;
+            continue;
+        }
+
+        const uint64_t latency = os_gettime_ns() - recv_ns;
+        latency_total += latency;
+        if (latency > latency_max) latency_max = latency;
+
+        if ((int64_t) pts <= last)
+            elog("Failed: frame %d after %d", (int) pts, (int) last);
+
+        if (frame.data[0][0] != (pts & 0xff) || frame.data[2][y_size / 4 - 1] != (pts & 0xff))
+            elog("Failed: frame %d torn", (int) pts);
+
+        last = (int64_t) pts;
+        received++;
+    }
+
+    ilog("%d frames, dropped %llu, publish -> read avg %.1fus max %.1fus, exit %d",
+        received, (unsigned long long) worker.ring->dropped,
+        received ? latency_total / 1e3 / received : 0, latency_max / 1e3, worker.last_exit);
+
+    if (received != WORKER_TEST_CRASH || worker.ring->dropped)
+        elog("Failed: frames lost");
+
+    if (!worker.should_restart() || worker.crashes != 1)
+        elog("Failed: crash not detected");
+
+    if (received && frame.data[0][y_size - 1] != (last & 0xff))
+        elog("Failed: last frame not intact after the crash");
+
+    dlog("~test_decode_worker");
+}
+#endif
+
 int main(int argc, char** argv) {
     (void) argc;
     (void) argv;
 
     net_init();
+    test_media_clock();
+    test_decode_scheduler();
+    test_replay_buffer();
+    test_sync_group();
+    #ifndef _WIN32
+    test_pipeline_latency();
+    test_chunked_latency();
+    test_usbmux_transport();
+    test_subnet_scan();
+    #endif
+    #ifdef __linux__
+    test_recv_backend();
+    test_decode_worker();
+    #endif
     test_exec();
     test_adb();
     test_ios();
@@ -0,0 +1,67 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum ThreadSched {
+    THREAD_SCHED_GLOBAL = -1, // use thread_defaults
+    THREAD_SCHED_DEFAULT,
+    THREAD_SCHED_NICE,
+    THREAD_SCHED_RR,
+    THREAD_SCHED_FIFO,
+};
+
+// Fixed, low real-time priority: above normal threads, below the
+// kernel's and audio servers' RT threads
+#define THREAD_RT_PRIORITY 10
+
+struct ThreadTuning {
+    int sched;          // ThreadSched
+    int nice;           // -20..19, for THREAD_SCHED_NICE and the RT fallback
+    char affinity[64];  // CPU list, eg. "2,3" or "4-7"; empty for any
+};
+
+// What a thread actually got, for the stats
+struct ThreadState {
+    char sched[32];     // eg. "fifo:10", "nice:-5", "rr denied,nice:-5"
+    char cpus[64];
+};
+
+// Global default, from the profile config
+extern struct ThreadTuning thread_defaults;
+
+// Name the calling thread and apply the tuning to it, falling back to
+// what the OS permits. Implemented per platform in sys/.
+void thread_tuning_apply(const char *name, const struct ThreadTuning *tuning,
+    struct ThreadState *state);
+
+// Parse a CPU list into a mask of the first 64 CPUs
+static inline bool parse_cpu_list(const char *list, uint64_t *mask) {
+    const char *p = list;
+    *mask = 0;
+
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0 || first > 63)
+            return false;
+
+        p = end;
+        if (*p == '-') {
+            last = strtol(++p, &end, 10);
+            if (end == p || last < first || last > 63)
+                return false;
+            p = end;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++)
+            *mask |= 1ULL << cpu;
+
+        while (*p == ',' || *p == ' ')
+            p++;
+    }
+
+    return *mask != 0;
+}
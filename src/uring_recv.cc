@@ -0,0 +1,240 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <errno.h>
+
+#include "plugin.h"
+#include "uring_recv.h"
+
+#if __linux__
+#include <linux/io_uring.h>
+#endif
+
+#if __linux__ && defined(IORING_FEAT_FAST_POLL)
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The recv and its linked timeout
+#define RING_ENTRIES 2
+#define RECV_DATA 1
+#define TIMEOUT_DATA 2
+
+// No liburing, the two syscalls are all that is needed
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+bool UringRecv::init(socket_t s) {
+    struct io_uring_params p;
+    uint8_t *base;
+
+    close();
+    memset(&p, 0, sizeof(p));
+    ring_fd = uring_setup(RING_ENTRIES, &p);
+    if (ring_fd < 0) {
+        ilog("io_uring: not available (%s), using blocking recv", strerror(errno));
+        return false;
+    }
+
+    // Single mmap is 5.4; with fast poll (5.7) a recv waits on the
+    // socket instead of blocking an io-wq thread
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_FAST_POLL)) {
+        ilog("io_uring: kernel too old, using blocking recv");
+        goto FAILED;
+    }
+
+    ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    if (ring_size < p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe))
+        ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring_fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        ring = NULL;
+        goto FAILED;
+    }
+
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        sqes = NULL;
+        goto FAILED;
+    }
+
+    base = (uint8_t*) ring;
+    sq_head  = (unsigned*) (base + p.sq_off.head);
+    sq_tail  = (unsigned*) (base + p.sq_off.tail);
+    sq_mask  = (unsigned*) (base + p.sq_off.ring_mask);
+    sq_array = (unsigned*) (base + p.sq_off.array);
+    cq_head  = (unsigned*) (base + p.cq_off.head);
+    cq_tail  = (unsigned*) (base + p.cq_off.tail);
+    cq_mask  = (unsigned*) (base + p.cq_off.ring_mask);
+    cqes = base + p.cq_off.cqes;
+
+    sock = s;
+    fallback = false;
+    ilog("io_uring: receiving on socket %d", (int) sock);
+    return true;
+
+FAILED:
+    close();
+    return false;
+}
+
+void UringRecv::close(void) {
+    if (ring_fd >= 0) ::close(ring_fd);
+    if (ring) munmap(ring, ring_size);
+    if (sqes) munmap(sqes, sqes_size);
+
+    ring_fd = -1;
+    ring = NULL;
+    sqes = NULL;
+    sock = INVALID_SOCKET;
+}
+
+// Receive into buf, with one io_uring_enter for submit and wait.
+// The timeout is linked, so the recv always completes (or is cancelled)
+// before this returns and buf is never written to afterwards.
+ssize_t UringRecv::submit_recv(void *buf, size_t len, int flags) {
+    static struct __kernel_timespec timeout = {URING_RECV_TIMEOUT, 0};
+    unsigned tail = *sq_tail;
+    struct io_uring_sqe *sqe;
+    unsigned index;
+
+    index = tail & *sq_mask;
+    sqe = &((struct io_uring_sqe*) sqes)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sock;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = (uint32_t) len;
+    sqe->msg_flags = (uint32_t) flags;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = RECV_DATA;
+    sq_array[index] = index;
+    tail++;
+
+    index = tail & *sq_mask;
+    sqe = &((struct io_uring_sqe*) sqes)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t) (uintptr_t) &timeout;
+    sqe->len = 1;
+    sqe->user_data = TIMEOUT_DATA;
+    sq_array[index] = index;
+    tail++;
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+    int res = -ETIME;
+    int submitted = 0;
+    int reaped = 0;
+    while (reaped < 2) {
+        unsigned head = *cq_head;
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            syscalls++;
+            int r = uring_enter(ring_fd, 2 - submitted, 2 - reaped, IORING_ENTER_GETEVENTS);
+            if (r < 0) {
+                if (errno == EINTR)
+                    continue;
+
+                elog("io_uring: enter failed: %s", strerror(errno));
+                return -1;
+            }
+            submitted += r;
+            continue;
+        }
+
+        struct io_uring_cqe *cqe = &((struct io_uring_cqe*) cqes)[head & *cq_mask];
+        if (cqe->user_data == RECV_DATA)
+            res = cqe->res;
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        completions++;
+        reaped++;
+    }
+
+    if (res >= 0) {
+        bytes += res;
+        return res;
+    }
+
+    // the timeout fired
+    if (res == -ECANCELED || res == -EINTR)
+        res = -EAGAIN;
+
+    if (res == -EINVAL && bytes == 0) {
+        ilog("io_uring: recv not supported, using blocking recv");
+        fallback = true;
+        return net_recv(sock, buf, len);
+    }
+
+    errno = -res;
+    return -1;
+}
+
+ssize_t UringRecv::recv(void *buf, size_t len) {
+    if (fallback)
+        return net_recv(sock, buf, len);
+
+    return submit_recv(buf, len, 0);
+}
+
+ssize_t UringRecv::recv_all(void *buf, size_t len) {
+    size_t received = 0;
+    while (received < len) {
+        // older kernels can return early even with MSG_WAITALL
+        ssize_t r = fallback
+            ? net_recv(sock, (uint8_t*) buf + received, len - received)
+            : submit_recv((uint8_t*) buf + received, len - received, MSG_WAITALL);
+        if (r <= 0)
+            return received ? (ssize_t) received : r;
+
+        received += r;
+    }
+
+    return (ssize_t) received;
+}
+
+// Nothing is buffered here, it is all still in the socket
+ssize_t UringRecv::pending(void) {
+    return net_recv_pending(sock);
+}
+
+#else // no io_uring
+
+bool UringRecv::init(socket_t s) {
+    (void) s;
+    return false;
+}
+
+void UringRecv::close(void) {}
+ssize_t UringRecv::recv(void *buf, size_t len) { return net_recv(sock, buf, len); }
+ssize_t UringRecv::recv_all(void *buf, size_t len) { return net_recv_all(sock, buf, len); }
+ssize_t UringRecv::pending(void) { return net_recv_pending(sock); }
+ssize_t UringRecv::submit_recv(void *buf, size_t len, int flags) {
+    (void) flags;
+    return net_recv(sock, buf, len);
+}
+
+#endif
@@ -0,0 +1,72 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "net.h"
+
+#define URING_RECV_TIMEOUT 5
+
+// io_uring receive for the video socket (Linux only).
+//
+// Each recv is a single IORING_OP_RECV straight into the caller's
+// buffer, linked to a timeout, submitted and waited for with one
+// io_uring_enter. recv_all asks for the whole length with MSG_WAITALL,
+// so a frame payload that takes several socket reads still costs one
+// syscall, and nothing is copied on the way.
+//
+// init() fails on kernels without io_uring (or older than 5.7, when
+// recv was not polled), where io_uring is disabled, and the caller keeps
+// using the blocking socket. A kernel that rejects the recv is detected
+// on the first one, which then falls back to net_recv on the same socket.
+struct UringRecv {
+    socket_t sock;
+    int ring_fd;
+    bool fallback;
+
+    // shared rings
+    void *ring;
+    size_t ring_size;
+    void *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    void *cqes;
+
+    // stats
+    uint64_t syscalls;
+    uint64_t completions;
+    uint64_t bytes;
+
+    UringRecv(void) {
+        sock = INVALID_SOCKET;
+        ring_fd = -1;
+        fallback = false;
+        ring = NULL;
+        sqes = NULL;
+        syscalls = 0;
+        completions = 0;
+        bytes = 0;
+    }
+
+    ~UringRecv(void) { close(); }
+
+    bool active(void) { return ring_fd >= 0; }
+
+    bool init(socket_t s);
+    void close(void);
+
+    // Same semantics as net_recv / net_recv_all / net_recv_pending.
+    // A recv with no data for URING_RECV_TIMEOUT seconds fails, like the
+    // receive timeout net_connect sets on the socket.
+    ssize_t recv(void *buf, size_t len);
+    ssize_t recv_all(void *buf, size_t len);
+    ssize_t pending(void);
+
+    // internal
+    ssize_t submit_recv(void *buf, size_t len, int flags);
+};
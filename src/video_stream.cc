@@ -0,0 +1,186 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <util/platform.h>
+
+#include "plugin.h"
+#include "buffer_util.h"
+#include "ffmpeg_decode.h"
+#include "mjpeg_decode.h"
+#include "video_stream.h"
+
+// The video socket is read through `ring` when io_uring is in use
+static inline ssize_t stream_recv(socket_t sock, UringRecv *ring, void *buf, size_t len) {
+    return ring ? ring->recv(buf, len) : net_recv(sock, buf, len);
+}
+
+static inline ssize_t stream_recv_all(socket_t sock, UringRecv *ring, void *buf, size_t len) {
+    return ring ? ring->recv_all(buf, len) : net_recv_all(sock, buf, len);
+}
+
+// Receive buf[start..total), feeding it to the decoder one NAL at a time.
+// Returns the number of bytes received, as net_recv_all.
+static ssize_t
+recv_chunked(socket_t sock, UringRecv *ring, uint8_t *buf, size_t start, size_t total, ChunkFeed *feed)
+{
+    size_t received = start;
+    size_t fed = 0;
+    size_t scan = 1;
+
+    while (received < total) {
+        ssize_t r = stream_recv(sock, ring, buf + received, total - received);
+        if (r <= 0)
+            return r;
+
+        received += r;
+        feed->recv_ns = os_gettime_ns();
+
+        // everything up to the last start code is made of complete NALs
+        size_t last = fed;
+        for (; scan + 2 < received; scan++) {
+            if (buf[scan] == 0 && buf[scan+1] == 0 && buf[scan+2] == 1)
+                last = scan;
+        }
+
+        if (last > fed) {
+            feed->decode(feed, buf + fed, last - fed);
+            fed = last;
+        }
+    }
+
+    feed->decode(feed, buf + fed, received - fed);
+    return (ssize_t) (received - start);
+}
+
+DataPacket*
+read_frame(Decoder *decoder, socket_t sock, int *has_config, ChunkFeed *feed, UringRecv *ring)
+{
+    uint8_t header[HEADER_SIZE];
+    uint8_t config[MAXCONFIG];
+    size_t r;
+    size_t len, config_len = 0;
+    uint64_t pts;
+
+    AGAIN:
+    r = stream_recv_all(sock, ring, header, HEADER_SIZE);
+    if (r != HEADER_SIZE) {
+        elog("read header recv returned %ld", r);
+        return NULL;
+    }
+
+    pts = buffer_read64be(header);
+    len = buffer_read32be(&header[8]);
+    // dlog("read_frame: header: pts=%llu len=%ld", pts, len);
+
+    if (pts == NO_PTS) {
+        if (config_len != 0) {
+             elog("double config ???");
+             return NULL;
+        }
+
+        if ((int)len == -1) {
+            elog("stop/error from app side");
+            return NULL;
+        }
+
+        if (len == 0 || len > MAXCONFIG) {
+            elog("config packet too large at %ld!", len);
+            return NULL;
+        }
+
+        r = stream_recv_all(sock, ring, config, len);
+        if (r != len) {
+            elog("read config recv returned %ld", r);
+            return NULL;
+        }
+
+        ilog("have config: %ld", len);
+        config_len = len;
+        *has_config = (int) len;
+        goto AGAIN;
+    }
+
+    if (len == 0 || len > MAXPACKET) {
+        elog("data packet too large at %ld!", len);
+        return NULL;
+    }
+
+    DataPacket* data_packet = decoder->pull_empty_packet(config_len + len);
+    uint8_t *p = data_packet->data;
+    if (config_len) {
+        memcpy(p, config, config_len);
+        p += config_len;
+    }
+
+    if (feed) {
+        feed->pts = pts;
+        r = recv_chunked(sock, ring, data_packet->data, config_len, config_len + len, feed);
+    } else {
+        r = stream_recv_all(sock, ring, p, len);
+    }
+
+    if (r != len) {
+        elog("read_frame: read %ld bytes wanted %ld", r, len);
+        decoder->push_empty_packet(data_packet);
+        return NULL;
+    }
+
+    data_packet->pts = pts;
+    data_packet->used = config_len + len;
+    return data_packet;
+}
+
+bool video_backlog(size_t *avg_packet_size, size_t used, ssize_t pending) {
+    *avg_packet_size = *avg_packet_size ? (*avg_packet_size * 15 + used) / 16 : used;
+
+    return pending >= INLINE_BACKLOG_MIN
+        && pending >= (ssize_t) (*avg_packet_size * INLINE_BACKLOG_FRAMES);
+}
+
+Decoder *create_video_decoder(enum VideoFormat format, bool chunks) {
+    Decoder *decoder;
+
+    if (format == FORMAT_AVC) {
+        FFMpegDecoder *d = new FFMpegDecoder();
+        d->chunks = chunks;
+        decoder = d;
+    }
+    else if (format == FORMAT_MJPG) {
+        decoder = new MJpegDecoder();
+    }
+    else {
+        elog("unexpected video format %d", format);
+        decoder = new MJpegDecoder();
+        decoder->failed = true;
+    }
+
+    return decoder;
+}
+
+bool init_video_decoder(Decoder *decoder, enum VideoFormat format, bool use_hw,
+    int mjpeg_backend)
+{
+    dlog("init video decoder");
+
+    if (format == FORMAT_AVC)
+        return ((FFMpegDecoder*)decoder)->init(NULL, AV_CODEC_ID_H264, use_hw) >= 0;
+
+    if (format == FORMAT_MJPG)
+        return ((MJpegDecoder*)decoder)->init(mjpeg_backend);
+
+    return false;
+}
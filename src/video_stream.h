@@ -0,0 +1,51 @@
+// Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+#pragma once
+#include <obs.h>
+
+#include "net.h"
+#include "source.h"
+#include "decoder.h"
+#include "uring_recv.h"
+
+// Reading and decoding the phone's video stream. Shared by the plugin
+// and the out of process decode worker.
+
+#define MAXCONFIG 1024
+#define MAXPACKET 1024 * 1024
+
+// Inline decode has no queue to absorb a slow decode.
+// A socket backlog of more than a few frames means we are falling behind.
+#define INLINE_BACKLOG_FRAMES 4
+#define INLINE_BACKLOG_MIN (64 * 1024)
+
+// Decode errors allowed in a window before the stream is given up on
+#define DECODE_RETRY_BUDGET 5
+#define DECODE_RETRY_WINDOW_NS (30 * 1000000000ULL)
+
+// Chunked ingest: complete NAL units are handed to `decode` while the
+// rest of the payload is still being received, so decoding a multi-slice
+// frame overlaps with its transfer.
+struct ChunkFeed {
+    void (*decode)(ChunkFeed *feed, uint8_t *data, size_t size);
+    struct droidcam_obs_source *plugin;
+    Decoder *decoder;
+    uint64_t pts;
+    uint64_t recv_ns;   // when the latest bytes arrived
+    uint64_t decode_ns;
+    bool failed;
+};
+
+// When the packet starts with a codec config (SPS/PPS, AAC ASC),
+// has_config is set to its length.
+// With a `feed`, the payload is decoded while it is being received.
+DataPacket*
+read_frame(Decoder *decoder, socket_t sock, int *has_config, ChunkFeed *feed = NULL, UringRecv *ring = NULL);
+
+// Update the running average frame size with a received packet of
+// `used` bytes. true when `pending` bytes still on the socket are a
+// backlog for inline decode to skip.
+bool video_backlog(size_t *avg_packet_size, size_t used, ssize_t pending);
+
+Decoder *create_video_decoder(enum VideoFormat format, bool chunks);
+bool init_video_decoder(Decoder *decoder, enum VideoFormat format, bool use_hw,
+    int mjpeg_backend);
@@ -0,0 +1,204 @@
+/*
+Copyright (C) 2024 DEV47APPS, github.com/dev47apps
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// droidcam-worker: decodes one video connection for the plugin.
+//
+//   droidcam-worker <format> <use_hw> <mjpeg_backend> <parent pid>
+//
+// The connected video socket is on fd 3 and the frame ring on fd 4, see
+// decode_worker.h. Runs until the stream ends, or the decoder gives up.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <util/base.h>
+#include <util/platform.h>
+
+#include "plugin.h"
+#include "decode_worker.h"
+#include "frame_hold.h"
+#include "video_stream.h"
+
+static void worker_log(int level, const char *format, va_list args, void *param) {
+    char msg[1024];
+    (void) param;
+
+    if (level > LOG_INFO)
+        return;
+
+    vsnprintf(msg, sizeof(msg), format, args);
+    fprintf(stderr, "%s: %s\n", WORKER_EXE, msg);
+}
+
+// Copy the decoded planes into the next free slot
+static void publish_frame(ShmRing *ring, const struct obs_source_frame2 *frame,
+    uint64_t pts, uint64_t recv_ns)
+{
+    static bool warned = false;
+    ShmSlot *slot = shm_ring_acquire(ring);
+    if (!slot) {
+        ring->dropped++;
+        return;
+    }
+
+    uint8_t *base = shm_slot_data(ring, ring->write_seq);
+    size_t offset = 0;
+
+    slot->frame = *frame;
+    for (int i = 0; i < MAX_AV_PLANES; i++) {
+        const size_t size = frame->data[i]
+            ? (size_t) frame->linesize[i] * FrameHold::plane_height(frame->format, i, frame->height)
+            : 0;
+
+        if (offset + size > SHM_SLOT_SIZE || (i == 0 && size == 0)) {
+            if (!warned) elog("frame format %d %ux%u does not fit a slot", (int) frame->format,
+                frame->width, frame->height);
+            warned = true;
+            ring->dropped++;
+            return;
+        }
+
+        if (size == 0) {
+            slot->frame.data[i] = NULL;
+            slot->offset[i] = 0;
+            continue;
+        }
+
+        memcpy(base + offset, frame->data[i], size);
+        slot->offset[i] = (uint32_t) offset;
+        offset += size;
+    }
+
+    slot->pts = pts;
+    slot->recv_ns = recv_ns;
+    shm_ring_publish(ring);
+}
+
+int main(int argc, char **argv) {
+    struct obs_source_frame2 frame;
+    uint8_t config[MAXCONFIG];
+    int config_len = 0;
+    int has_config;
+    int errors = 0;
+    uint64_t error_ns = 0;
+    bool recovering = false;
+    bool got_output;
+    DataPacket *packet;
+
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s <format> <use_hw> <mjpeg_backend> <parent pid>\n", argv[0]);
+        return WORKER_EXIT_SETUP;
+    }
+
+    // Go away with the plugin, also if it died before this was set
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if ((int) getppid() != atoi(argv[4]))
+        return WORKER_EXIT_SETUP;
+
+    // Whatever else OBS had open without close-on-exec
+    const long max_fd = sysconf(_SC_OPEN_MAX);
+    for (int fd = WORKER_SHM_FD + 1; fd < max_fd && fd < 4096; fd++)
+        close(fd);
+
+    const enum VideoFormat format = (enum VideoFormat) atoi(argv[1]);
+    const bool use_hw = atoi(argv[2]) != 0;
+    const int mjpeg_backend = atoi(argv[3]);
+    base_set_log_handler(worker_log, NULL);
+
+    ShmRing *ring = (ShmRing*) mmap(NULL, shm_ring_size(), PROT_READ | PROT_WRITE, MAP_SHARED,
+        WORKER_SHM_FD, 0);
+    if (ring == MAP_FAILED || ring->magic != SHM_RING_MAGIC || ring->slot_size != SHM_SLOT_SIZE) {
+        elog("no frame ring on fd %d", WORKER_SHM_FD);
+        return WORKER_EXIT_SETUP;
+    }
+
+    net_init();
+    Decoder *decoder = create_video_decoder(format, false);
+    if (decoder->failed || !init_video_decoder(decoder, format, use_hw, mjpeg_backend)) {
+        elog("could not initialize decoder");
+        return WORKER_EXIT_DECODE;
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.format = VIDEO_FORMAT_NONE;
+    frame.range  = VIDEO_RANGE_DEFAULT;
+
+    // Same handling as the plugin's in process decode
+    while ((packet = read_frame(decoder, WORKER_SOCK_FD, &has_config)) != NULL) {
+        packet->recv_ns = os_gettime_ns();
+
+        if (has_config && has_config <= (int) sizeof(config)) {
+            if (config_len && (has_config != config_len || memcmp(config, packet->data, has_config) != 0)) {
+                ilog("video: codec config changed");
+                decoder->flush();
+                frame.format = VIDEO_FORMAT_NONE;
+                frame.range  = VIDEO_RANGE_DEFAULT;
+            }
+
+            memcpy(config, packet->data, has_config);
+            config_len = has_config;
+        }
+
+        if (recovering) {
+            if (!decoder->is_keyframe(packet)) {
+                decoder->push_empty_packet(packet);
+                continue;
+            }
+
+            frame.format = VIDEO_FORMAT_NONE;
+            frame.range  = VIDEO_RANGE_DEFAULT;
+            if (!decoder->reopen(config, config_len))
+                return WORKER_EXIT_DECODE;
+
+            recovering = false;
+        }
+
+        const uint64_t start = os_gettime_ns();
+        if (!decoder->decode_video(&frame, packet, &got_output)) {
+            if (errors == 0 || start - error_ns > DECODE_RETRY_WINDOW_NS) {
+                errors = 0;
+                error_ns = start;
+            }
+
+            if (++errors > DECODE_RETRY_BUDGET) {
+                elog("too many video decode errors, giving up on the stream");
+                return WORKER_EXIT_DECODE;
+            }
+
+            elog("error decoding video, waiting for a keyframe (%d/%d)", errors, DECODE_RETRY_BUDGET);
+            recovering = true;
+            decoder->push_empty_packet(packet);
+            continue;
+        }
+
+        const uint64_t decode_ns = os_gettime_ns() - start;
+        ring->decode_ns = ring->decode_ns ? (ring->decode_ns * 15 + decode_ns) / 16 : decode_ns;
+        ring->decoded++;
+
+        if (got_output)
+            publish_frame(ring, &frame, packet->pts, packet->recv_ns);
+
+        decoder->push_empty_packet(packet);
+    }
+
+    // The decoder is left to the exit, its teardown can be slow
+    return WORKER_EXIT_STREAM;
+}